@@ -0,0 +1,410 @@
+// Microbenchmarks of grid operations, reports time and heap allocations per operation.
+//
+// Usage: GridBenchmark [--radii 1,2,4] [--grids 1,100] [--storage linked|ring|chunked|all]
+//                      [--layout overlapping|disjoint|all] [--shape square|disc|all]
+//                      [--max-cells N] [--full]
+//
+// Configurations with more than --max-cells cells in total are skipped unless --full is set.
+#include "DynamicGrid.h"
+#include "GridStencil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace serenity;
+
+static uint64 nNumAllocs = 0;
+
+// Every allocation form is replaced and kept out of line. Once inlined, GCC pairs the
+// malloc and free inside them with the operators at the call sites and warns
+FORCENOINLINE void* operator new(size_t size)
+{
+	nNumAllocs++;
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+FORCENOINLINE void* operator new[](size_t size) { return operator new(size); }
+
+FORCENOINLINE void operator delete(void* p) noexcept { std::free(p); }
+FORCENOINLINE void operator delete(void* p, size_t) noexcept { std::free(p); }
+FORCENOINLINE void operator delete[](void* p) noexcept { std::free(p); }
+FORCENOINLINE void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace
+{
+	enum class Layout : uint8_t
+	{
+		OVERLAPPING,	// neighbour grids share half of their cells
+		DISJOINT		// grids never share cells
+	};
+
+	struct Options
+	{
+		std::vector<int> radii = { 1, 2, 4, 8, 16 };
+		std::vector<int> grids = { 1, 10, 100, 1000, 10000 };
+		std::vector<GridStorage> storages = { GridStorage::LINKED, GridStorage::RING, GridStorage::CHUNKED };
+		std::vector<Layout> layouts = { Layout::OVERLAPPING, Layout::DISJOINT };
+		std::vector<GridShape> shapes = { GridShape::SQUARE };
+		int64 nMaxCells = 4000000;
+	};
+
+	// Drops everything it is given, measures the grid work alone
+	class NullSink : public GridSink
+	{
+	public:
+		void OnCreated(const Cell::ptr& /*cell*/) override {}
+		void OnDeleted(void*&& /*data*/) override {}
+	};
+
+	struct Result
+	{
+		double ns = 0;
+		double allocs = 0;
+	};
+
+	const char* ToString(GridStorage storage)
+	{
+		switch (storage)
+		{
+		case GridStorage::RING:		return "ring";
+		case GridStorage::CHUNKED:	return "chunked";
+		default:					return "linked";
+		}
+	}
+
+	const char* ToString(GridShape shape)
+	{
+		return shape == GridShape::DISC ? "disc" : "square";
+	}
+
+	const char* ToString(Layout layout)
+	{
+		return layout == Layout::DISJOINT ? "disjoint" : "overlapping";
+	}
+
+	std::vector<int> ParseList(const char* arg)
+	{
+		std::vector<int> values;
+		std::string s(arg);
+		size_t pos = 0;
+		while (pos < s.size())
+		{
+			size_t next = s.find(',', pos);
+			if (next == std::string::npos)
+				next = s.size();
+			values.push_back(std::atoi(s.substr(pos, next - pos).c_str()));
+			pos = next + 1;
+		}
+		return values;
+	}
+
+	template<typename F>
+	Result Measure(int64 ops, F&& body)
+	{
+		uint64 allocs = nNumAllocs;
+		auto start = std::chrono::steady_clock::now();
+
+		body();
+
+		auto end = std::chrono::steady_clock::now();
+		Result r;
+		r.ns = std::chrono::duration<double, std::nano>(end - start).count() / ops;
+		r.allocs = double(nNumAllocs - allocs) / ops;
+		return r;
+	}
+
+	GridShape shape = GridShape::SQUARE;
+
+	void Report(const char* op, GridStorage storage, Layout layout, int radius, int numGrids, const Result& r)
+	{
+		std::printf("%-18s %-7s %-6s %-12s %6d %7d %14.1f %12.2f\n",
+			op, ToString(storage), ToString(shape), ToString(layout), radius, numGrids, r.ns, r.allocs);
+	}
+
+	// Centres of the grids on a square lattice, the step decides how much they overlap
+	std::vector<FIntPoint> MakePositions(Layout layout, int radius, int numGrids)
+	{
+		int side = 1;
+		while (side * side < numGrids)
+			side++;
+
+		int step = layout == Layout::DISJOINT ? 2 * radius : FMath::Max(radius, 1);
+
+		std::vector<FIntPoint> positions;
+		positions.reserve(numGrids);
+		for (int i = 0; i < numGrids; i++)
+			positions.push_back(FIntPoint((i % side) * step, (i / side) * step));
+		return positions;
+	}
+
+	void RunConfig(GridStorage storage, Layout layout, int radius, int numGrids)
+	{
+		const int steps = 4;
+		const int lookups = 16;
+		const int teleport = 1 << 12;
+
+		GridManager manager;
+		std::vector<Grid::ptr> grids;
+		grids.reserve(numGrids);
+		for (int i = 0; i < numGrids; i++)
+			grids.push_back(manager.CreateGrid(storage, shape));
+
+		std::vector<FIntPoint> positions = MakePositions(layout, radius, numGrids);
+
+		auto moveAll = [&](FIntPoint delta, int count)
+		{
+			for (int s = 0; s < count; s++)
+			{
+				for (int i = 0; i < numGrids; i++)
+				{
+					positions[i] += delta;
+					grids[i]->MoveTo(positions[i]);
+				}
+			}
+		};
+
+		Report("Init", storage, layout, radius, numGrids, Measure(numGrids, [&]()
+		{
+			for (int i = 0; i < numGrids; i++)
+				grids[i]->Init(positions[i], radius);
+		}));
+
+		Report("GetAllCells", storage, layout, radius, numGrids, Measure(numGrids, [&]()
+		{
+			for (int i = 0; i < numGrids; i++)
+				grids[i]->GetAllCells();
+		}));
+
+		// Same walk without building an array
+		Report("ForEachCell", storage, layout, radius, numGrids, Measure(numGrids, [&]()
+		{
+			int64 visited = 0;
+			for (int i = 0; i < numGrids; i++)
+				grids[i]->ForEachCell([&](const Cell::ptr&) { visited++; });
+
+			if (visited < numGrids)
+				std::fprintf(stderr, "ForEachCell missed cells\n");
+		}));
+
+		// Walk a fixed pattern of indices inside every grid
+		Report("FindCellByIndex", storage, layout, radius, numGrids, Measure(int64(numGrids) * lookups, [&]()
+		{
+			int span = 2 * radius - 1;
+			for (int i = 0; i < numGrids; i++)
+			{
+				for (int k = 0; k < lookups; k++)
+				{
+					int x = (k * 7) % span - (radius - 1);
+					int y = (k * 11) % span - (radius - 1);
+					grids[i]->FindCellByIndex(positions[i] + FIntPoint(x, y));
+				}
+			}
+		}));
+
+		// 3x3 passes over the same cells with float payloads, per cell:
+		// heat is gathered from the payloads, blurred and written back
+		{
+			typedef TCell<float> HeatCell;
+
+			TGridManager<float> heat;
+			heat.SetPayloadHooks([](HeatCell& c) { c.GetData() = float((c.GetIndex().X ^ c.GetIndex().Y) & 15); }, nullptr);
+
+			std::vector<TGrid<float>::ptr> heatGrids;
+			heatGrids.reserve(numGrids);
+			for (int i = 0; i < numGrids; i++)
+			{
+				heatGrids.push_back(heat.CreateGrid(storage, shape));
+				heatGrids[i]->Init(positions[i], radius);
+			}
+
+			TGridStencil<float, float> stencil;
+			int64 cells = FMath::Max(heat.GetCellStats().numLive, (int64)1);
+			const float blur[9] = { 0.0625f, 0.125f, 0.0625f, 0.125f, 0.25f, 0.125f, 0.0625f, 0.125f, 0.0625f };
+
+			Report("Stencil gather", storage, layout, radius, numGrids, Measure(cells, [&]()
+			{
+				stencil.Gather(heat, [](const HeatCell& c) { return c.GetData(); });
+			}));
+
+			Report("Stencil convolve", storage, layout, radius, numGrids, Measure(cells * steps, [&]()
+			{
+				for (int s = 0; s < steps; s++)
+					stencil.Convolve(blur);
+			}));
+
+			Report("Stencil scatter", storage, layout, radius, numGrids, Measure(cells, [&]()
+			{
+				stencil.Scatter(heat, [](HeatCell& c, const float& value) { c.GetData() = value; });
+			}));
+		}
+
+		Report("MoveTo unit", storage, layout, radius, numGrids, Measure(int64(numGrids) * steps, [&]()
+		{
+			moveAll(FIntPoint(1, 0), steps);
+		}));
+
+		Report("MoveTo unit sink", storage, layout, radius, numGrids, Measure(int64(numGrids) * steps, [&]()
+		{
+			NullSink sink;
+			for (int s = 0; s < steps; s++)
+			{
+				for (int i = 0; i < numGrids; i++)
+				{
+					positions[i] += FIntPoint(1, 0);
+					grids[i]->MoveTo(positions[i], sink);
+				}
+			}
+		}));
+
+		Report("MoveTo diagonal", storage, layout, radius, numGrids, Measure(int64(numGrids) * steps, [&]()
+		{
+			moveAll(FIntPoint(1, 1), steps);
+		}));
+
+		// Same unit steps, one batch per tick
+		Report("MoveAll unit", storage, layout, radius, numGrids, Measure(int64(numGrids) * steps, [&]()
+		{
+			TArray<GridManager::Move> moves;
+			moves.Reserve(numGrids);
+
+			for (int s = 0; s < steps; s++)
+			{
+				moves.Reset();
+				for (int i = 0; i < numGrids; i++)
+				{
+					positions[i] += FIntPoint(1, 0);
+					moves.Push({ grids[i], positions[i] });
+				}
+				manager.MoveAll(moves);
+			}
+		}));
+
+		// Same batches with grids that do not share cells moved on worker threads
+		manager.SetConcurrent(true);
+		Report("MoveAll unit par", storage, layout, radius, numGrids, Measure(int64(numGrids) * steps, [&]()
+		{
+			TArray<GridManager::Move> moves;
+			moves.Reserve(numGrids);
+
+			for (int s = 0; s < steps; s++)
+			{
+				moves.Reset();
+				for (int i = 0; i < numGrids; i++)
+				{
+					positions[i] += FIntPoint(1, 0);
+					moves.Push({ grids[i], positions[i] });
+				}
+				manager.MoveAll(moves);
+			}
+		}));
+		manager.SetConcurrent(false);
+
+		Report("MoveTo teleport", storage, layout, radius, numGrids, Measure(numGrids, [&]()
+		{
+			moveAll(FIntPoint(teleport, 0), 1);
+		}));
+
+		Report("Clear", storage, layout, radius, numGrids, Measure(numGrids, [&]()
+		{
+			for (int i = 0; i < numGrids; i++)
+				grids[i]->Clear();
+		}));
+
+		// Grow from the smallest grid, shrinking is not measured
+		for (int i = 0; i < numGrids; i++)
+			grids[i]->Init(positions[i], 1);
+
+		Report("Resize", storage, layout, radius, numGrids, Measure(numGrids, [&]()
+		{
+			for (int i = 0; i < numGrids; i++)
+				grids[i]->Resize(radius);
+		}));
+
+		for (int i = 0; i < numGrids; i++)
+			grids[i]->Clear();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	bool bFull = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool bHasValue = i + 1 < argc;
+
+		if (!std::strcmp(argv[i], "--radii") && bHasValue)
+			options.radii = ParseList(argv[++i]);
+		else if (!std::strcmp(argv[i], "--grids") && bHasValue)
+			options.grids = ParseList(argv[++i]);
+		else if (!std::strcmp(argv[i], "--max-cells") && bHasValue)
+			options.nMaxCells = std::atoll(argv[++i]);
+		else if (!std::strcmp(argv[i], "--full"))
+			bFull = true;
+		else if (!std::strcmp(argv[i], "--storage") && bHasValue)
+		{
+			std::string v = argv[++i];
+			if (v == "linked")
+				options.storages = { GridStorage::LINKED };
+			else if (v == "ring")
+				options.storages = { GridStorage::RING };
+			else if (v == "chunked")
+				options.storages = { GridStorage::CHUNKED };
+		}
+		else if (!std::strcmp(argv[i], "--layout") && bHasValue)
+		{
+			std::string v = argv[++i];
+			if (v == "overlapping")
+				options.layouts = { Layout::OVERLAPPING };
+			else if (v == "disjoint")
+				options.layouts = { Layout::DISJOINT };
+		}
+		else if (!std::strcmp(argv[i], "--shape") && bHasValue)
+		{
+			std::string v = argv[++i];
+			if (v == "square")
+				options.shapes = { GridShape::SQUARE };
+			else if (v == "disc")
+				options.shapes = { GridShape::DISC };
+			else if (v == "all")
+				options.shapes = { GridShape::SQUARE, GridShape::DISC };
+		}
+		else
+		{
+			std::fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	std::printf("%-18s %-7s %-6s %-12s %6s %7s %14s %12s\n",
+		"op", "storage", "shape", "layout", "radius", "grids", "ns/op", "allocs/op");
+
+	for (GridShape gridShape : options.shapes)
+	for (GridStorage storage : options.storages)
+	{
+		for (Layout layout : options.layouts)
+		{
+			for (int radius : options.radii)
+			{
+				for (int numGrids : options.grids)
+				{
+					int64 side = 2 * radius - 1;
+					if (!bFull && side * side * numGrids > options.nMaxCells)
+						continue;
+
+					shape = gridShape;
+					RunConfig(storage, layout, radius, numGrids);
+				}
+			}
+		}
+	}
+
+	return 0;
+}
@@ -1,6 +1,11 @@
 #pragma once
+#include <atomic>
 #include <memory>
 #include "CoreMinimal.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Containers/Queue.h"
+#include "Misc/ScopeLock.h"
 
 namespace serenity
 {
@@ -33,79 +38,514 @@ namespace serenity
 		{"UNDEFINED",	Direction::UNDEFINED}
 	};
 
+	// How a grid keeps track of its own cells
+	enum class GridStorage : uint8_t
+	{
+		LINKED,	// looks its cells up in the manager index by world position
+		RING,	// also keeps them in a dense toroidal array of (2r-1)^2 slots, wrapped by world index
+		CHUNKED	// owns whole pool slabs under the square, for radii in the hundreds and more
+	};
+
+	// Area a grid covers around its center
+	enum class GridShape : uint8_t
+	{
+		SQUARE,	// (2r-1)^2 cells
+		DISC	// cells within about r-1/2 of the center, roughly a fifth fewer
+	};
+
+	// Load state of a cell payload, see TGridManager::SetLoader
+	enum class CellState : uint8_t
+	{
+		UNLOADED,	// nothing was requested or the request was cancelled
+		LOADING,	// queued or being loaded on a worker
+		READY		// loaded payload is in the cell
+	};
+
 	static Direction GetOpposite(Direction side);
 	static FIntVector GetVector(Direction side);
 
-	class Cell
+	template<typename T> class TCellPool;
+	template<typename T> class TCellLoader;
+	template<typename T> class TGrid;
+	template<typename T> class TGridManager;
+
+	// Cell of the world, T is the payload stored inline in the cell
+	template<typename T>
+	class TCell
 	{
 	public:
-		typedef TSharedPtr<Cell> ptr;
-		typedef TWeakPtr<Cell> w_ptr;
+		// Thread safe counts, MoveAll workers copy pointers sharing the count of a slab
+		typedef TSharedPtr<TCell, ESPMode::ThreadSafe> ptr;
+		typedef TWeakPtr<TCell, ESPMode::ThreadSafe> w_ptr;
 
-		static Cell::ptr MakeCell(FIntPoint index = FIntPoint(0, 0));
+		static ptr MakeCell(FIntPoint index = FIntPoint(0, 0));
 
 	public:
-		Cell();
+		TCell();
 
-		FIntPoint GetIndex();
+		FIntPoint GetIndex() const;
 		void SetIndex(int x, int y);
 		void SetIndex(FIntPoint pos);
 
-		Cell::ptr GetN(Direction dir);
-		void SetN(Direction dir, Cell::ptr g);
+		// Neighbours are derived from the index through the pool, nothing is stored
+		const ptr& GetN(Direction dir) const;
 
-		void*& GetData();
+		T& GetData();
+		const T& GetData() const;
 
-		size_t& NumOwners();
+		std::atomic<size_t>& NumOwners();
+
+		// Cell is owned by prefetch bands only, no grid covers it yet
+		bool IsSpeculative() const;
 		
 		bool IsValid() const;
 
+		CellState GetState() const;
+
+		// 0 for full cells, an aggregate of level k covers 2^k x 2^k full cells
+		// and its index is the full index divided by 2^k, see TGrid::SetLod
+		int GetLevel() const;
+
+		// Unique within the pool, changes every time the cell is acquired or released.
+		// A load started for another generation belongs to a cell that is gone,
+		// even when its slot was reused for the same index since
+		uint64 GetGeneration() const;
+
 		void Reset();
 
 		bool bIsReseted = false;
 
 	protected:
+		friend class TCellPool<T>;
+		friend class TCellLoader<T>;
+		friend class TGrid<T>;
 
 		bool bIsValid = false;
 
-		size_t nNumOwners = 1;
+		std::atomic<size_t> nNumOwners{ 1 };
+
+		// Owners that only prefetch the cell, part of nNumOwners
+		std::atomic<size_t> nNumSpeculative{ 0 };
 
-		void* pMetaData = nullptr;
+		CellState state = CellState::UNLOADED;
+		uint8 nLevel = 0;
+		std::atomic<uint64> nGeneration{ 0 };
+
+		T Data = T();
 
 		FIntPoint index;
 
-		Cell::ptr Front		= nullptr; //Y+
-		Cell::ptr Back		= nullptr; //Y-
-		Cell::ptr Left		= nullptr; //X+
-		Cell::ptr Right		= nullptr; //X-
-		Cell::ptr FrontR	= nullptr;
-		Cell::ptr BackR		= nullptr;
-		Cell::ptr BackL		= nullptr;
-		Cell::ptr FrontL	= nullptr;
+		// Owner of the cell, null for cells made outside of a pool
+		TCellPool<T>* pool = nullptr;
+	};
+
+	// Cell counters of a pool, a manager without grids must have no live cells
+	struct CellStats
+	{
+		int64 numLive = 0;
+		int64 numCreated = 0;	// since the pool was made
+		int64 numReleased = 0;
+		int numCached = 0;		// released payloads waiting to be revived
+		int numSlabs = 0;
+		int numFreeSlabs = 0;
+	};
+
+	// Timed grid operations
+	enum class GridOp : uint8
+	{
+		INIT,
+		MOVE,
+		RESIZE,
+		CLEAR,
+		MOVE_ALL,	// whole batch, counted by the manager only
+		NUM
+	};
+
+	// Durations of one operation, bucket i counts calls that took [2^i, 2^(i+1)) ns
+	struct LatencyHistogram
+	{
+		static const int NumBuckets = 40;
+
+		int64 buckets[NumBuckets] = {};
+		int64 count = 0;
+		int64 totalNs = 0;
+		int64 maxNs = 0;
+
+		void Add(int64 ns);
+		void Append(const LatencyHistogram& other);
+
+		double MeanNs() const;
+		// Upper edge of the bucket the given share of calls fits under, 0.99 for p99
+		int64 PercentileNs(double fraction) const;
+	};
+
+	// Work done by grids since they were made or their metrics were reset
+	struct GridMetrics
+	{
+		int64 numCreated = 0;		// cells made or revived for the grid
+		int64 numReleased = 0;		// cells the grid was the last owner of
+		int64 numShared = 0;		// cells the grid got from another owner
+		int64 numLookups = 0;		// FindCellByIndex calls
+		int64 numGroupedPlans = 0;	// MoveAll plans sorted by GroupPlans
+		int64 numOverlapChecks = 0;	// plan pairs it checked for overlap
+
+		LatencyHistogram latency[(int)GridOp::NUM];
+
+		void Append(const GridMetrics& other);
+
+		double AverageOverlapChecks() const;
+	};
+
+	// Adds the time of the outermost timed operation to the histogram, nested ones are part of it
+	class ScopedLatency
+	{
+	public:
+		ScopedLatency(LatencyHistogram& histogram, bool& bBusy);
+		~ScopedLatency();
+
+	private:
+		LatencyHistogram* histogram;
+		bool* bBusy;
+		uint64 nStartCycles;
+	};
+
+	// Allocates cells in slabs, one slab per SlabSide x SlabSide world region.
+	// A cell always lives in the same slot of its region slab, and slabs
+	// without live cells go to a free list to be reused by other regions.
+	// Regions are spread over shards, each with its own lock when thread safe
+	template<typename T>
+	class TCellPool
+	{
+	public:
+		typedef TCell<T> Cell;
+		typedef TSharedPtr<Cell, ESPMode::ThreadSafe> CellPtr;
+
+		static const int SlabShift = 4;
+		static const int SlabSide = 1 << SlabShift;
+		static const int SlabSize = SlabSide * SlabSide;
+
+		static const int NumShards = 64;
+
+		TCellPool();
+		~TCellPool();
+
+		// Returns a fresh cell at the index, there must be no live cell there.
+		// bRevived is set if the cell got its payload back from the cache
+		CellPtr Acquire(FIntPoint index, bool* bRevived = nullptr);
+
+		// Adds an owner to every cell of the region, missing cells are created or revived.
+		// Cells that became alive and speculative cells that got a real owner are appended
+		void AcquireRegion(FIntPoint region, TArray<CellPtr>& created, TArray<CellPtr>& promoted, TArray<CellPtr>& revived);
+
+		// Drops an owner of every live cell of the region, payloads of released cells go to onReleased.
+		// Returns how many cells were released
+		template<typename F>
+		int ReleaseRegion(FIntPoint region, F&& onReleased);
+
+		// Resets the cell, its slot becomes free. The payload goes to the cache if there
+		// is one, onDeleted gets it otherwise together with payloads evicted from the cache
+		template<typename F>
+		void Release(CellPtr c, F&& onDeleted);
+
+		// Returns the live cell at the index
+		const CellPtr& Find(FIntPoint index) const;
+
+		// Calls f with every live cell in the rectangle, slab by slab and row by row inside
+		// a slab, looking every slab up once. f may release cells but must not create any
+		template<typename F>
+		void ForEachInRect(FIntPoint min, FIntPoint max, F&& f) const;
+
+		// Same for every live cell of the pool
+		template<typename F>
+		void ForEachLive(F&& f) const;
+
+		int NumSlabs() const;
+		int NumFreeSlabs() const;
+		CellStats GetStats() const;
+
+		static FIntPoint GetRegion(FIntPoint index);
+
+		// Shards are locked only while the pool is used from several threads
+		void SetThreadSafe(bool bEnable);
+
+		// Level given to cells of the pool, pools of aggregate cells have one above 0
+		void SetLevel(int level);
+
+		// Run on the payload right after a cell is created and right before it is released.
+		// A cached payload is released when it is evicted, a revived one is not created again
+		TFunction<void(Cell&)> OnCreate;
+		TFunction<void(Cell&)> OnRelease;
+
+		// New cells are queued for loading, released ones have their loads cancelled
+		void SetLoader(TCellLoader<T>* cellLoader);
+
+		// Keeps up to maxCells released payloads, and up to maxBytes of them if payloadSize is set.
+		// Payloads already kept stay until they are revived or the cache is emptied
+		void SetCache(int maxCells, int64 maxBytes, TFunction<int64(const T&)> payloadSize);
+
+		// Releases every cached payload
+		template<typename F>
+		void EmptyCache(F&& onDeleted);
+
+		int NumCached() const;
+
+	protected:
+		// Payload of a released cell, entries form a list from the most recently released
+		struct CacheEntry
+		{
+			FIntPoint index;
+			T data = T();
+			CellState state = CellState::UNLOADED;
+			int64 nBytes = 0;
+			int prev = -1;
+			int next = -1;
+		};
+
+		// Moves the cached payload of the index into the cell
+		bool TakeCached(FIntPoint index, Cell& c);
+		// Caches the payload, payloads pushed out of the cache are appended to evicted
+		void PutCached(FIntPoint index, T&& data, CellState state, TArray<TPair<FIntPoint, T>>& evicted);
+		void UnlinkCached(int idx);
+		// Runs the release hook on a payload that has no cell anymore
+		T ReleaseEvicted(FIntPoint index, T&& data);
+
+		struct Slab
+		{
+			Cell cells[SlabSize];
+		};
+
+		struct SlabEntry
+		{
+			TSharedPtr<Slab, ESPMode::ThreadSafe> data;
+
+			// Handed out pointers share the control block of the slab
+			TArray<CellPtr> cells;
+
+			int nNumLive = 0;
+			FIntPoint region;
+		};
+
+		struct Shard
+		{
+			TArray<SlabEntry> slabs;
+			TArray<int> freeSlabs;
+
+			// Region -> slab
+			TMap<FIntPoint, int> regions;
+
+			FCriticalSection lock;
+		};
+
+		// Locks the shard if the pool is thread safe
+		class ShardLock
+		{
+		public:
+			ShardLock(const TCellPool& pool, Shard& shard);
+			~ShardLock();
+
+		private:
+			FCriticalSection* cs;
+		};
+
+		static int GetSlot(FIntPoint index);
+		static int GetShard(FIntPoint region);
+
+		// Cells of the slab of the region, null if it has none alive
+		const CellPtr* FindSlabCells(FIntPoint region) const;
+
+		// Slab of the region, taken from the free list or allocated when there is none. Shard must be locked
+		int FindOrAddSlab(Shard& shard, FIntPoint region);
+		// Makes a dead cell alive at the index. Shard must be locked
+		void MakeAlive(SlabEntry& entry, Cell& c, FIntPoint index);
+
+		// Slots of a slab never move, so references to handed out cells stay valid
+		mutable Shard shards[NumShards];
+
+		bool bThreadSafe = false;
+
+		// Source of cell generations, shared by all slots of the pool
+		std::atomic<uint64> nNextGeneration{ 0 };
+
+		std::atomic<int64> nNumCreated{ 0 };
+		std::atomic<int64> nNumReleased{ 0 };
+
+		TArray<CacheEntry> cache;
+		TArray<int> freeCache;
+		TMap<FIntPoint, int> cacheIndex;
+		int nCacheHead = -1;
+		int nCacheTail = -1;
+		int nCacheMaxCells = 0;
+		int64 nCacheMaxBytes = 0;
+		int64 nCacheBytes = 0;
+		uint8 nLevel = 0;
+		std::atomic<int> nNumCached{ 0 };
+		TFunction<int64(const T&)> cacheSizeOf;
+		mutable FCriticalSection cacheLock;
+
+		TCellLoader<T>* loader = nullptr;
 	};
 
-	struct Delivered
+	// Loads payloads of new cells on background threads. Workers only see the
+	// index, finished payloads wait in a queue until Pump finds their cells in
+	// the pool, so cells are only touched by the thread that owns the grids
+	template<typename T>
+	class TCellLoader
 	{
-		TArray<Cell::ptr> created;
-		TArray<void*> deleted;
+	public:
+		typedef TCell<T> Cell;
+		typedef TSharedPtr<Cell, ESPMode::ThreadSafe> CellPtr;
+
+		// load is called on workers, several at once, with the index of the cell
+		TCellLoader(const TCellPool<T>& pool, TFunction<T(FIntPoint)> load, TFunction<void(Cell&)> onLoaded);
+
+		// Waits for loads already running, their results are dropped
+		~TCellLoader();
+
+		// Queues the cell, could be called from any thread
+		void Request(const CellPtr& c);
+
+		// Forgets the pending load of a cell that is being released, a load that
+		// has not started yet is skipped
+		void Cancel(Cell& c);
+
+		// Moves up to maxCells finished payloads into their cells, all of them if negative.
+		// Returns the number of cells that became ready
+		int Pump(int maxCells = -1);
 
-		friend Delivered& operator+= (Delivered& dst, const Delivered& src)
+		// Cells that are still loading
+		int NumPending() const;
+
+	protected:
+		// Set once the request is cancelled, shared with its task
+		typedef TSharedPtr<std::atomic<bool>, ESPMode::ThreadSafe> Token;
+
+		struct Result
+		{
+			FIntPoint index;
+			uint64 generation = 0;
+			Token token;
+			T data = T();
+		};
+
+		const TCellPool<T>& pool;
+		TFunction<T(FIntPoint)> load;
+		TFunction<void(Cell&)> onLoaded;
+
+		TQueue<Result, EQueueMode::Mpsc> done;
+
+		std::atomic<bool> bStopped{ false };
+
+		// Token of the pending request of every index, Request runs on MoveAll workers too
+		TMap<FIntPoint, Token> tokens;
+		FCriticalSection tokensLock;
+
+		// Tasks given to workers and not finished yet
+		std::atomic<int> nInFlight{ 0 };
+		std::atomic<int> nPending{ 0 };
+	};
+
+	// Receives cells as soon as a grid creates or releases them
+	template<typename T>
+	class TGridSink
+	{
+	public:
+		virtual ~TGridSink() {}
+
+		virtual void OnCreated(const TSharedPtr<TCell<T>, ESPMode::ThreadSafe>& cell) = 0;
+
+		// Payload of a cell that nobody owns anymore
+		virtual void OnDeleted(T&& data) = 0;
+
+		// Speculative cell was reached by a grid, see TGrid::SetPrefetch
+		virtual void OnPromoted(const TSharedPtr<TCell<T>, ESPMode::ThreadSafe>& /*cell*/) {}
+
+		// Cell came back with the payload it was released with, see TGridManager::SetCellCache.
+		// Its payload was not reported as deleted
+		virtual void OnRevived(const TSharedPtr<TCell<T>, ESPMode::ThreadSafe>& /*cell*/) {}
+
+		// Aggregate cell entered or left the coarse bands of a grid, see TGrid::SetLod
+		virtual void OnLodCreated(const TSharedPtr<TCell<T>, ESPMode::ThreadSafe>& /*cell*/) {}
+		virtual void OnLodDeleted(int /*level*/, T&& /*data*/) {}
+	};
+
+	// Sink collecting everything into arrays
+	template<typename T>
+	struct TDelivered : public TGridSink<T>
+	{
+		TArray<typename TCell<T>::ptr> created;
+
+		// Payloads of released cells
+		TArray<T> deleted;
+
+		// Prefetched cells now covered by a grid, they were listed in created before
+		TArray<typename TCell<T>::ptr> promoted;
+
+		// Cells brought back from the cache with their payloads
+		TArray<typename TCell<T>::ptr> revived;
+
+		// Aggregate cells, kept apart from full ones
+		TArray<typename TCell<T>::ptr> lodCreated;
+		TArray<TPair<int, T>> lodDeleted;
+
+		void OnCreated(const TSharedPtr<TCell<T>, ESPMode::ThreadSafe>& cell) override
+		{
+			created.Push(cell);
+		}
+
+		void OnPromoted(const TSharedPtr<TCell<T>, ESPMode::ThreadSafe>& cell) override
+		{
+			promoted.Push(cell);
+		}
+
+		void OnRevived(const TSharedPtr<TCell<T>, ESPMode::ThreadSafe>& cell) override
+		{
+			revived.Push(cell);
+		}
+
+		void OnDeleted(T&& data) override
+		{
+			deleted.Push(MoveTemp(data));
+		}
+
+		void OnLodCreated(const TSharedPtr<TCell<T>, ESPMode::ThreadSafe>& cell) override
+		{
+			lodCreated.Push(cell);
+		}
+
+		void OnLodDeleted(int level, T&& data) override
+		{
+			lodDeleted.Push({ level, MoveTemp(data) });
+		}
+
+		friend TDelivered& operator+= (TDelivered& dst, const TDelivered& src)
 		{
 			dst.created.Append(src.created);
 			dst.deleted.Append(src.deleted);
+			dst.promoted.Append(src.promoted);
+			dst.revived.Append(src.revived);
+			dst.lodCreated.Append(src.lodCreated);
+			dst.lodDeleted.Append(src.lodDeleted);
 			return dst;
 		}
 	};
 
-	class Grid
+	template<typename T>
+	class TGrid
 	{
 	public:
 		typedef Direction Dir;
-		typedef TSharedPtr<Grid> ptr;
+		typedef TSharedPtr<TGrid> ptr;
+
+		typedef TCell<T> Cell;
+		typedef TSharedPtr<Cell, ESPMode::ThreadSafe> CellPtr;
+		typedef TDelivered<T> Delivered;
+		typedef TGridSink<T> Sink;
+		typedef TGridManager<T> GridManager;
+		typedef TGrid<T> Grid;
 
 	public:
 
-		Grid(TArray<Grid::ptr>& grids);
+		TGrid(GridManager& owner, GridStorage mode = GridStorage::LINKED, GridShape shape = GridShape::SQUARE);
 
 		// Creates grid by entered world position with relevant radius
 		Delivered Init(int x, int y, int radius);
@@ -124,43 +564,186 @@ namespace serenity
 		// Reset all cells and removes them
 		Delivered Clear();
 
+		// Same as above, but cells are reported to the sink while the grid changes
+		void Init(int x, int y, int radius, Sink& sink);
+		void Init(FIntPoint pos, int radius, Sink& sink);
+		void MoveTo(int x, int y, Sink& sink);
+		void MoveTo(FIntPoint pos, Sink& sink);
+		void Resize(int radius, Sink& sink);
+		void Clear(Sink& sink);
+
 		// Returns current root cell
-		Cell::ptr GetRoot();
+		CellPtr GetRoot();
 
 		const FIntPoint GetPosFromDir(Direction dir);
 
 		int GetRadius() const;
-		TArray<Cell::ptr> GetAllCells();
-
-		Cell::ptr FindCellByIndex(FIntPoint index);
-		Cell::ptr FindCellByIndex(int x, int y);
+		GridStorage GetStorage() const;
+		GridShape GetShape() const;
+		TArray<CellPtr> GetAllCells();
+
+		// Call f with every cell of the grid as a const CellPtr&, slab by slab and without
+		// copying pointers. f must not move, resize or clear grids of the manager
+		template<typename F>
+		void ForEachCell(F&& f) const;
+		// Cells of the grid inside the rectangle of world indices, bounds included
+		template<typename F>
+		void ForEachCellInRect(FIntPoint min, FIntPoint max, F&& f) const;
+		// Cells of the grid inner to outer steps away from the center, a diagonal step counts as one
+		template<typename F>
+		void ForEachCellInRing(int inner, int outer, F&& f) const;
+
+		CellPtr FindCellByIndex(FIntPoint index);
+		CellPtr FindCellByIndex(int x, int y);
+
+		// Keeps cells ahead of the moving grid alive, rows * last step cells deep.
+		// They are created as speculative and reported to the sink, then promoted
+		// once the grid covers them or dropped when it turns away. Takes effect
+		// with the next move, 0 turns prefetching off
+		void SetPrefetch(int rows);
+		int GetPrefetch() const;
+
+		// Last step of the grid, zero after a jump farther than the radius
+		FIntPoint GetVelocity() const;
+		const TArray<CellPtr>& GetPrefetchedCells() const;
+
+		// Cells leaving the grid are kept until they are more than radius + rows away,
+		// so a grid moving back and forth does not recreate them. The area of the
+		// grid is not changed by this. Takes effect with the next move
+		void SetHysteresis(int rows);
+		int GetHysteresis() const;
+		const TArray<CellPtr>& GetRetainedCells() const;
+
+		// Coarse bands around the grid. radii[i] is the outer radius, in full cells, of the
+		// band of level i + 1 aggregates, which are 2^(i+1) cells wide. A band holds the
+		// aggregates touching its square that are not wholly under the finer one, so the
+		// bands leave no gaps and overlap only at their inner edges. Aggregates are shared
+		// between grids like full cells. Takes effect with the next Init, move or resize,
+		// an empty array turns the bands off. Square grids only, radii are clamped to the
+		// radius limit times the aggregate width
+		void SetLod(const TArray<int>& radii);
+		const TArray<int>& GetLod() const;
+
+		// Aggregates of the level the grid holds now, level from 1
+		TArray<CellPtr> GetLodCells(int level) const;
+		// Aggregate of the level over the full index, if the grid holds it
+		CellPtr FindLodCell(int level, FIntPoint index) const;
+
+		// Counters and latencies of this grid, see TGridManager::GetMetrics
+		GridMetrics GetMetrics() const;
+		void ResetMetrics();
 
 	private:
+		friend class TGridManager<T>;
 
-		Cell::ptr root = nullptr;
+		CellPtr root = nullptr;
 		int nRadius = 1;
 		bool bIsInit = false;
 		
 		int nLimMax = 16;
 		const int nLimMin = 1;
 
-		//TODO:   ""        , 
-		//  ,    
-		Delivered Expand(Direction direction);
-		Delivered NarrowDown(Direction direction);
+		GridStorage storage = GridStorage::LINKED;
+		GridShape shape = GridShape::SQUARE;
 
-		// Same as expand, but with considering collided grids
-		Delivered Expand(Direction direction, TArray<Grid::ptr>& collideGrids);
+		// RING storage: slot of index (x, y) is (x mod width, y mod width)
+		TArray<CellPtr> ring;
+		int nRingWidth = 0;
 
-		bool Link(Cell::ptr g1, Cell::ptr g2);
-		bool LinkNeighbours(Cell::ptr g);
+		// Speculatively owned cells ahead of the grid
+		TArray<CellPtr> prefetched;
+		int nPrefetchRows = 0;
+		FIntPoint velocity = FIntPoint(0, 0);
 
-		Cell::ptr MakeNeighbour(Cell::ptr g, Direction dir);
-		TArray<Cell::ptr> MakeNeighbours(Cell::ptr& g);
-		TArray<Cell::ptr> SelectBorder(Direction direction);
+		// Cells out of the grid kept alive by hysteresis
+		TArray<CellPtr> retained;
+		int nHysteresis = 0;
 
-		Cell::ptr FindLast(Direction direction);
-		TArray<Grid::ptr> FindCollidedGrids(FIntPoint index, int radius);
+		// Coarse band of one level, in aggregate indices. Inner rectangle is empty
+		// when min > max
+		struct LodBand
+		{
+			FIntPoint outerMin;
+			FIntPoint outerMax;
+			FIntPoint innerMin = FIntPoint(0, 0);
+			FIntPoint innerMax = FIntPoint(-1, -1);
+
+			bool Contains(FIntPoint c) const;
+			bool operator==(const LodBand& other) const;
+		};
+
+		TArray<int> lodRadii;
+		TArray<LodBand> lodBands;
+
+		// Bands of every level for the center and the current radii
+		TArray<LodBand> MakeLodBands(FIntPoint center) const;
+		// Takes aggregates of the bands the grid does not hold yet
+		void AcquireLod(const TArray<LodBand>& bands, Sink& sink);
+		// Drops held aggregates out of the bands, which become the held ones
+		void ReleaseLod(const TArray<LodBand>& bands, Sink& sink);
+		// Moves the bands to the center in one go, for calls that do not interleave with other grids
+		void UpdateLod(FIntPoint center, Sink& sink);
+
+		// Same as AcquireCell and ReleaseCell for an aggregate of the level
+		void AcquireLodCell(int level, FIntPoint index, Sink& sink);
+		void ReleaseLodCell(int level, FIntPoint index, Sink& sink);
+		// Calls f for every aggregate of band a that is out of band b, b may be null
+		template<typename F>
+		static void ForEachBandDifference(const LodBand& a, const LodBand* b, F&& f);
+
+		// Counted by the thread that changes the grid, lookups could come from others
+		GridMetrics metrics;
+		std::atomic<int64> nNumLookups{ 0 };
+		bool bTiming = false;
+
+		// Shares the loaded cell at index or creates a new one
+		CellPtr AcquireCell(FIntPoint index, Sink& sink);
+		// Drops one owner of the cell and resets it when nobody owns it anymore
+		void ReleaseCell(CellPtr c, Sink& sink);
+
+		// Remembers the step and takes the band ahead of center. The old band
+		// is kept until DropPrefetched, so cells the grid leaves behind while
+		// turning around are not recreated
+		TArray<CellPtr> Prefetch(FIntPoint center, FIntPoint step, Sink& sink);
+		void DropPrefetched(Sink& sink);
+
+		// Takes retained and leaving cells still close enough to the new center.
+		// Old ones are released by DropRetained after the move
+		TArray<CellPtr> Retain(FIntPoint from, FIntPoint to);
+		void DropRetained(Sink& sink);
+
+		// CHUNKED storage: pool regions under the square
+		static void ChunkRect(FIntPoint center, int radius, FIntPoint& min, FIntPoint& max);
+		// CHUNKED storage: takes or drops chunks of the square around center that are not
+		// under the other square, otherRadius of 0 means there is no other square
+		void AcquireChunks(FIntPoint center, int radius, FIntPoint other, int otherRadius, Sink& sink);
+		void ReleaseChunks(FIntPoint center, int radius, FIntPoint other, int otherRadius, Sink& sink);
+
+		// How far from the center the grid touches cells, chunks reach past the square
+		int GetReach() const;
+
+		// RING storage: fill the ring around center, reusing cells already in it
+		void RingRebuild(FIntPoint center, int radius, Sink& sink);
+		int RingSlot(FIntPoint index) const;
+
+		// Calls f for every index of the square around center that is out of the square around other
+		template<typename F>
+		static void ForEachSquareDifference(FIntPoint center, FIntPoint other, int radius, F&& f);
+
+		// Same for discs, row by row. Radii may differ, 0 means there is no other disc
+		template<typename F>
+		static void ForEachDiscDifference(FIntPoint center, int radius, FIntPoint other, int otherRadius, F&& f);
+
+		// Difference of the grid's own areas around center and other
+		template<typename F>
+		void ForEachAreaDifference(FIntPoint center, FIntPoint other, F&& f) const;
+
+		// Offset from the center is inside the area of the radius
+		static bool InArea(GridShape shape, int radius, FIntPoint offset);
+		// Half width of the row at the vertical offset, -1 if the row is out of the area
+		static int RowExtent(GridShape shape, int radius, int dy);
+		// CHUNKED storage: the region has cells in the area around center
+		bool ChunkInArea(FIntPoint region, FIntPoint center, int radius) const;
 
 		Direction IndexToDirection(FIntPoint& idx);
 		
@@ -176,31 +759,164 @@ namespace serenity
 		// Get opposite direction
 		Direction GetOpposite(Direction dir);
 
-		TArray<Grid::ptr>& rootGrids;
+		GridManager& manager;
+		TArray<ptr>& rootGrids;
 
-		// tmp
-		TArray<Cell::w_ptr> cells;
+		// Last MoveAll batch that planned the grid
+		uint32 nMoveStamp = 0;
 	};
 
-	class GridManager
+	template<typename T>
+	class TGridManager
 	{
 	public:
-		typedef TSharedPtr<GridManager> ptr;
+		typedef TSharedPtr<TGridManager> ptr;
 
-		GridManager();
-		~GridManager();
+		typedef TCell<T> Cell;
+		typedef TSharedPtr<Cell, ESPMode::ThreadSafe> CellPtr;
+		typedef TGrid<T> Grid;
+		typedef TSharedPtr<Grid> GridPtr;
+		typedef TDelivered<T> Delivered;
+		typedef TGridSink<T> Sink;
 
-		Grid::ptr CreateGrid();
-		bool DestroyGrid(Grid::ptr g);
-
-		// TODO: move function
+		// Grid and the position it goes to, see MoveAll
+		struct Move
+		{
+			GridPtr grid;
+			FIntPoint target;
+		};
+
+		TGridManager();
+		~TGridManager();
+
+		GridPtr CreateGrid(GridStorage mode = GridStorage::LINKED, GridShape shape = GridShape::SQUARE);
+		// Clears the grid and forgets it. Payloads of released cells go to the sink,
+		// without one they are only seen by the release hook
+		bool DestroyGrid(GridPtr g);
+		bool DestroyGrid(GridPtr g, Sink& sink);
+
+		// Returns the live cell at the world index, shared by all grids of this manager
+		CellPtr FindCell(FIntPoint index) const;
+		CellPtr FindCell(int x, int y) const;
+
+		// Live, created and released cells of the manager, for leak checks
+		CellStats GetCellStats() const;
+
+		// Same as the iterators of TGrid over all live cells of the manager. A cell shared
+		// by several grids is visited once
+		template<typename F>
+		void ForEachCell(F&& f) const;
+		template<typename F>
+		void ForEachCellInRect(FIntPoint min, FIntPoint max, F&& f) const;
+		template<typename F>
+		void ForEachCellInRing(FIntPoint center, int inner, int outer, F&& f) const;
+
+		// Live aggregate at the aggregate index of the level, see TGrid::SetLod
+		CellPtr FindLodCell(int level, FIntPoint index) const;
+		// Same counters for the aggregates of one level
+		CellStats GetLodStats(int level) const;
+
+		// Keeps payloads of released cells, so a grid coming back revives its cells instead
+		// of creating them again. Least recently released payloads are evicted once there are
+		// more than maxCells of them, or more than maxBytes counted by payloadSize. Evicted
+		// payloads are reported as deleted by the call that evicts them. Cells still loading
+		// are not kept. 0 cells stops caching, what is kept stays until EmptyCellCache
+		void SetCellCache(int maxCells, int64 maxBytes = 0, TFunction<int64(const T&)> payloadSize = nullptr);
+		void EmptyCellCache(Sink& sink);
+		int NumCachedCells() const;
+
+		// Hooks run on the payload of every cell when it is created and before it is released
+		void SetPayloadHooks(TFunction<void(Cell&)> onCreate, TFunction<void(Cell&)> onRelease);
+		const TFunction<void(Cell&)>& GetCreateHook() const;
+		const TFunction<void(Cell&)>& GetReleaseHook() const;
+
+		// Moves all grids at once. Cells passed from one grid to another are kept,
+		// so every cell is listed at most once in the result. A grid is moved by
+		// its first entry only, grids that are not initialized are skipped
+		Delivered MoveAll(TArrayView<Move> moves);
+		void MoveAll(TArrayView<Move> moves, Sink& sink);
+
+		// Lets MoveAll update grids that do not share cells on worker threads.
+		// Other calls of the manager and its grids still have to come from one thread,
+		// payload hooks are called from the workers
+		void SetConcurrent(bool bEnable);
+		bool IsConcurrent() const;
+
+		// Loads the payload of every new cell on background threads, so grids can
+		// move without waiting for it. Cells stay LOADING until PumpLoads hands
+		// the payload over and calls onLoaded, a cell released before that never
+		// gets it. Loaded payload replaces the one set by the create hook.
+		// Set it before grids are created, a null load turns loading off
+		void SetLoader(TFunction<T(FIntPoint index)> load, TFunction<void(Cell&)> onLoaded = nullptr);
+
+		// Call once per tick, maxCells limits the work done in one call
+		int PumpLoads(int maxCells = -1);
+		int NumPendingLoads() const;
+
+		// Sum of the metrics of all grids, destroyed ones included, and MoveAll latencies.
+		// Counting costs a few additions and two clock reads per operation
+		GridMetrics GetMetrics() const;
+		void ResetMetrics();
 
 	protected:
+		friend class TGrid<T>;
+
+		// Splits the ring around the center into up to four rectangles and calls visit(min, max) for each
+		template<typename F>
+		static void ForEachRingRect(FIntPoint center, int inner, int outer, F&& visit);
+
+		struct MovePlan
+		{
+			Grid* grid;
+			FIntPoint from;
+			FIntPoint to;
+		};
+
+		// Takes entering cells of all plans, then drops leaving ones
+		void MovePlans(TArrayView<MovePlan> plans, Sink& sink);
 
-		TArray<Grid::ptr> rootGrids;
+		// Splits plans into groups that never touch the same cell
+		TArray<TArray<MovePlan>> GroupPlans(const TArray<MovePlan>& plans);
+
+		TArray<GridPtr> rootGrids;
+
+		// GroupPlans buckets plans by squares of 2^BucketShift cells
+		static const int BucketShift = 5;
+		uint32 nMoveStamp = 0;
+
+		bool bConcurrent = false;
+
+		// Metrics of destroyed grids and of the manager's own operations
+		GridMetrics metrics;
+		bool bTiming = false;
+
+		// Storage of every live cell, also serves as spatial index by world position
+		TCellPool<T> cellPool;
+
+		// Aggregate cells, pool i keeps level i + 1
+		TArray<TUniquePtr<TCellPool<T>>> lodPools;
+		static const int MaxLodLevels = 8;
+		void ReserveLodLevels(int levels);
+
+		// Destroyed before the pool, so no load is running while cells go away
+		TUniquePtr<TCellLoader<T>> loader;
 	};
 
 	// Checks if cell usable
-	bool IsValid(Cell::ptr p);
+	template<typename T>
+	bool IsValid(const TSharedPtr<TCell<T>, ESPMode::ThreadSafe>& p)
+	{
+		return p.IsValid() && p->IsValid();
+	}
+
+	// Untyped flavour, payload is a pointer to user data
+	typedef TCell<void*>		Cell;
+	typedef TCellPool<void*>	CellPool;
+	typedef TDelivered<void*>	Delivered;
+	typedef TGridSink<void*>	GridSink;
+	typedef TGrid<void*>		Grid;
+	typedef TGridManager<void*> GridManager;
 }
 
+#include "DynamicGrid.inl"
+
@@ -0,0 +1,2615 @@
+#pragma once
+
+namespace serenity
+{
+template<typename T>
+TGrid<T>::TGrid(GridManager& owner, GridStorage mode, GridShape shape) : storage(mode), shape(shape), manager(owner), rootGrids(owner.rootGrids)
+{
+	// Cost of a chunked grid grows with its chunks, so it is allowed to be much larger
+	if (storage == GridStorage::CHUNKED)
+		nLimMax = 4096;
+}
+
+template<typename T>
+Direction TGrid<T>::IndexToDirection(FIntPoint& idx)
+{
+	if		(idx.X ==  1  && idx.Y ==  0)		return Direction::FRONT;
+	else if (idx.X == -1  && idx.Y ==  0)		return Direction::BACK;
+	else if (idx.X ==  0  && idx.Y == -1)		return Direction::LEFT;
+	else if (idx.X ==  0  && idx.Y ==  1)		return Direction::RIGHT;
+	else if (idx.X ==  1  && idx.Y ==  1)		return Direction::FRONT_RIGHT;
+	else if (idx.X ==  1  && idx.Y == -1)		return Direction::FRONT_LEFT;
+	else if (idx.X == -1  && idx.Y ==  1)		return Direction::BACK_RIGHT;
+	else if (idx.X == -1  && idx.Y == -1)		return Direction::BACK_LEFT;
+
+	return Direction::UNDEFINED;
+}
+
+template<typename T>
+const FIntPoint TGrid<T>::GetPosFromDir(Direction dir)
+{
+	auto pos = FIntPoint(0, 0);
+
+	switch (dir)
+	{
+	case Direction::FRONT:
+		pos = FIntPoint(1, 0);
+		break;
+	case Direction::BACK:
+		pos = FIntPoint(-1, 0);
+		break;
+
+	case Direction::RIGHT:
+		pos = FIntPoint(0, 1);
+		break;
+	case Direction::LEFT:
+		pos = FIntPoint(0, -1);
+		break;
+
+	case Direction::FRONT_RIGHT:
+		pos = FIntPoint(1, 1);
+		break;
+	case Direction::FRONT_LEFT:
+		pos = FIntPoint(1, -1);
+		break;
+
+	case Direction::BACK_RIGHT:
+		pos = FIntPoint(-1, 1);
+		break;
+	case Direction::BACK_LEFT:
+		pos = FIntPoint(-1, -1);
+		break;
+	}
+
+	return pos;
+}
+
+template<typename T>
+bool TGrid<T>::IsInit()
+{
+	return bIsInit;
+}
+
+template<typename T>
+bool TGrid<T>::IsCurrent(FIntPoint index)
+{
+	// Check if index in grid field
+	return InArea(shape, nRadius, index - root->GetIndex());
+}
+
+template<typename T>
+bool TGrid<T>::InArea(GridShape shape, int radius, FIntPoint offset)
+{
+	if (shape == GridShape::SQUARE)
+		return FMath::Abs(offset.X) < radius && FMath::Abs(offset.Y) < radius;
+
+	// Cell centers within r - 1/2 of the center, (r - 1/2)^2 rounded down
+	int r = radius - 1;
+	return offset.X * offset.X + offset.Y * offset.Y <= r * r + r;
+}
+
+template<typename T>
+int TGrid<T>::RowExtent(GridShape shape, int radius, int dy)
+{
+	int r = radius - 1;
+	if (r < 0 || FMath::Abs(dy) > r)
+		return -1;
+
+	if (shape == GridShape::SQUARE)
+		return r;
+
+	// Largest w with w^2 + dy^2 <= r^2 + r, the float root is only a first guess
+	int rest = r * r + r - dy * dy;
+	int w = (int)FMath::Sqrt((float)rest);
+	while (w * w > rest)
+		w--;
+	while ((w + 1) * (w + 1) <= rest)
+		w++;
+
+	return w;
+}
+
+template<typename T>
+Direction TGrid<T>::GetCW(Direction dir)
+{
+	switch (dir)
+	{
+	case Direction::FRONT:
+		return Direction::FRONT_RIGHT;
+		break;
+
+	case Direction::BACK:
+		return Direction::BACK_LEFT;
+		break;
+
+	case Direction::LEFT:
+		return Direction::FRONT_LEFT;
+		break;
+
+	case Direction::RIGHT:
+		return Direction::BACK_RIGHT;
+		break;
+
+	case Direction::FRONT_RIGHT:
+		return Direction::RIGHT;
+		break;
+
+	case Direction::BACK_RIGHT:
+		return Direction::BACK;
+		break;
+
+	case Direction::BACK_LEFT:
+		return Direction::LEFT;
+		break;
+
+	case Direction::FRONT_LEFT:
+		return Direction::FRONT;
+		break;
+	}
+
+	return Direction::UNDEFINED;
+}
+
+template<typename T>
+Direction TGrid<T>::GetCCW(Direction dir)
+{
+	switch (dir)
+	{
+	case Direction::FRONT:
+		return Direction::FRONT_LEFT;
+		break;
+
+	case Direction::BACK:
+		return Direction::BACK_RIGHT;
+		break;
+
+	case Direction::LEFT:
+		return Direction::BACK_LEFT;
+		break;
+
+	case Direction::RIGHT:
+		return Direction::FRONT_RIGHT;
+		break;
+
+	case Direction::FRONT_RIGHT:
+		return Direction::FRONT;
+		break;
+
+	case Direction::BACK_RIGHT:
+		return Direction::RIGHT;
+		break;
+
+	case Direction::BACK_LEFT:
+		return Direction::BACK;
+		break;
+
+	case Direction::FRONT_LEFT:
+		return Direction::LEFT;
+		break;
+	}
+
+	return Direction::UNDEFINED;
+}
+
+template<typename T>
+Direction TGrid<T>::GetOpposite(Direction dir)
+{
+	switch (dir)
+	{
+	case Direction::FRONT:
+		return Direction::BACK;
+		break;
+
+	case Direction::BACK:
+		return Direction::FRONT;
+		break;
+
+	case Direction::LEFT:
+		return Direction::RIGHT;
+		break;
+
+	case Direction::RIGHT:
+		return Direction::LEFT;
+		break;
+
+	case Direction::FRONT_RIGHT:
+		return Direction::BACK_LEFT;
+		break;
+
+	case Direction::BACK_RIGHT:
+		return Direction::FRONT_LEFT;
+		break;
+
+	case Direction::BACK_LEFT:
+		return Direction::FRONT_RIGHT;
+		break;
+
+	case Direction::FRONT_LEFT:
+		return Direction::BACK_RIGHT;
+		break;
+	}
+
+	return Direction::UNDEFINED;
+}
+
+template<typename T>
+TDelivered<T> TGrid<T>::Resize(int radius)
+{
+	Delivered delivered;
+	Resize(radius, delivered);
+
+	return delivered;
+}
+
+template<typename T>
+void TGrid<T>::Resize(int radius, Sink& sink)
+{
+	if (radius <= 0)
+		return;
+
+	ScopedLatency timer(metrics.latency[(int)GridOp::RESIZE], bTiming);
+
+	radius = FMath::Clamp(radius, nLimMin, nLimMax);
+
+	if (storage == GridStorage::RING)
+		RingRebuild(root->GetIndex(), radius, sink);
+	else if (storage == GridStorage::CHUNKED)
+	{
+		auto center = root->GetIndex();
+		AcquireChunks(center, radius, center, nRadius, sink);
+		ReleaseChunks(center, nRadius, center, radius, sink);
+
+		nRadius = radius;
+	}
+	else if (radius != nRadius && shape == GridShape::DISC)
+	{
+		auto center = root->GetIndex();
+
+		if (radius > nRadius)
+			ForEachDiscDifference(center, radius, center, nRadius, [&](FIntPoint index)
+				{
+					AcquireCell(index, sink);
+				});
+		else
+			ForEachDiscDifference(center, nRadius, center, radius, [&](FIntPoint index)
+				{
+					ReleaseCell(manager.FindCell(index), sink);
+				});
+
+		nRadius = radius;
+	}
+	else if (radius != nRadius)
+	{
+		// Whole band between the old and the new square in one pass. Rows go in
+		// the order cells lie in pool slabs, cells of other grids are shared
+		bool bGrow = radius > nRadius;
+		int inner = FMath::Min(radius, nRadius) - 1;
+		int outer = FMath::Max(radius, nRadius) - 1;
+		auto center = root->GetIndex();
+
+		auto visit = [&](int x, int y)
+		{
+			if (bGrow)
+				AcquireCell(FIntPoint(x, y), sink);
+			else
+				ReleaseCell(manager.FindCell(x, y), sink);
+		};
+
+		for (int y = center.Y - outer; y <= center.Y + outer; y++)
+		{
+			// Rows crossing the inner square have cells at both ends only
+			if (FMath::Abs(y - center.Y) <= inner)
+			{
+				for (int x = center.X - outer; x < center.X - inner; x++)
+					visit(x, y);
+				for (int x = center.X + inner + 1; x <= center.X + outer; x++)
+					visit(x, y);
+			}
+			else
+				for (int x = center.X - outer; x <= center.X + outer; x++)
+					visit(x, y);
+		}
+
+		nRadius = radius;
+	}
+
+	// Coarse bands start at the edge of the grid
+	UpdateLod(root->GetIndex(), sink);
+
+	// Band depends on the radius
+	if (prefetched.Num() || nPrefetchRows > 0)
+	{
+		TArray<CellPtr> ahead = Prefetch(root->GetIndex(), velocity, sink);
+		DropPrefetched(sink);
+		prefetched = MoveTemp(ahead);
+	}
+
+	// Retained cells the grid has grown over are its own again
+	if (retained.Num())
+	{
+		TArray<CellPtr> kept = Retain(root->GetIndex(), root->GetIndex());
+		DropRetained(sink);
+		retained = MoveTemp(kept);
+	}
+}
+
+template<typename T>
+void TGrid<T>::Init(int x, int y, int radius, Sink& sink)
+{
+	if (bIsInit) return;
+
+	ScopedLatency timer(metrics.latency[(int)GridOp::INIT], bTiming);
+
+	if (radius < 1)
+		radius = 1;
+
+	if (storage == GridStorage::RING)
+	{
+		RingRebuild(FIntPoint(x, y), radius, sink);
+		UpdateLod(FIntPoint(x, y), sink);
+		bIsInit = true;
+
+		return;
+	}
+
+	if (storage == GridStorage::CHUNKED)
+	{
+		nRadius = FMath::Clamp(radius, nLimMin, nLimMax);
+		AcquireChunks(FIntPoint(x, y), nRadius, FIntPoint(x, y), 0, sink);
+
+		root = manager.FindCell(x, y);
+		UpdateLod(FIntPoint(x, y), sink);
+		bIsInit = true;
+
+		return;
+	}
+
+	// Root could be already loaded by another grid
+	if (!IsValid(root))
+		root = AcquireCell({ x, y }, sink);
+	
+	Resize(radius, sink);
+
+	bIsInit = true;
+}
+
+template<typename T>
+TDelivered<T> TGrid<T>::Init(int x, int y, int radius)
+{
+	Delivered delivered;
+	Init(x, y, radius, delivered);
+
+	return delivered;
+}
+
+template<typename T>
+TDelivered<T> TGrid<T>::Init(FIntPoint pos, int radius)
+{
+	return Init(pos.X, pos.Y, radius);
+}
+
+template<typename T>
+void TGrid<T>::Init(FIntPoint pos, int radius, Sink& sink)
+{
+	Init(pos.X, pos.Y, radius, sink);
+}
+
+template<typename T>
+void TGrid<T>::MoveTo(int x, int y, Sink& sink)
+{
+	if (root->GetIndex() == FIntPoint(x, y)) return;
+
+	ScopedLatency timer(metrics.latency[(int)GridOp::MOVE], bTiming);
+
+	// Find difference between new and old positions
+	auto dt = FIntPoint(x, y) - root->GetIndex();
+
+	// Band ahead and cells kept behind are taken before the move, the current ones are dropped after it
+	TArray<CellPtr> ahead = Prefetch(FIntPoint(x, y), dt, sink);
+	TArray<CellPtr> kept = Retain(root->GetIndex(), FIntPoint(x, y));
+
+	// Take the new part of the square and drop the old one in one pass, for any shift.
+	// Cells shared by both squares are not touched, even after a jump
+	if (storage == GridStorage::RING)
+	{
+		TArray<LodBand> bands = MakeLodBands(FIntPoint(x, y));
+		AcquireLod(bands, sink);
+
+		// Entering cell takes the slot of the leaving one with the same index modulo width
+		ForEachAreaDifference(FIntPoint(x, y), root->GetIndex(), [&](FIntPoint index)
+			{
+				int slot = RingSlot(index);
+
+				CellPtr leaving = ring[slot];
+				ring[slot] = AcquireCell(index, sink);
+				ReleaseCell(leaving, sink);
+			});
+
+		// Disc rows do not pair up, leaving cells without a successor still hold their slots
+		if (shape == GridShape::DISC)
+			ForEachAreaDifference(root->GetIndex(), FIntPoint(x, y), [&](FIntPoint index)
+				{
+					auto& cc = ring[RingSlot(index)];
+					if (IsValid(cc) && cc->GetIndex() == index)
+					{
+						ReleaseCell(cc, sink);
+						cc = nullptr;
+					}
+				});
+
+		root = ring[RingSlot(FIntPoint(x, y))];
+
+		ReleaseLod(bands, sink);
+	}
+	else
+	{
+		typename GridManager::MovePlan plan = { this, root->GetIndex(), FIntPoint(x, y) };
+		manager.MovePlans(TArrayView<typename GridManager::MovePlan>(&plan, 1), sink);
+	}
+
+	DropPrefetched(sink);
+	prefetched = MoveTemp(ahead);
+
+	DropRetained(sink);
+	retained = MoveTemp(kept);
+}
+
+template<typename T>
+TDelivered<T> TGrid<T>::MoveTo(int x, int y)
+{
+	Delivered delivered;
+	MoveTo(x, y, delivered);
+
+	if constexpr (TIsPointer<T>::Value)
+		delivered.deleted.RemoveAll([&](const T& cc) { return cc == nullptr; });
+
+	return delivered;
+}
+
+template<typename T>
+TDelivered<T> TGrid<T>::MoveTo(FIntPoint pos)
+{
+	return MoveTo(pos.X, pos.Y);
+}
+
+template<typename T>
+void TGrid<T>::MoveTo(FIntPoint pos, Sink& sink)
+{
+	MoveTo(pos.X, pos.Y, sink);
+}
+
+template<typename T>
+TDelivered<T> TGrid<T>::Clear()
+{
+	Delivered delivered;
+	Clear(delivered);
+
+	return delivered;
+}
+
+template<typename T>
+void TGrid<T>::Clear(Sink& sink)
+{
+	if (!IsValid(root)) 
+		return;
+
+	ScopedLatency timer(metrics.latency[(int)GridOp::CLEAR], bTiming);
+
+	if (storage == GridStorage::CHUNKED)
+		ReleaseChunks(root->GetIndex(), nRadius, root->GetIndex(), 0, sink);
+	else
+	{
+		// Releasing only frees slots, so the walk over the slabs stays valid
+		ForEachCell([&](const CellPtr& c)
+			{
+				ReleaseCell(c, sink);
+			});
+	}
+
+	DropPrefetched(sink);
+	DropRetained(sink);
+	ReleaseLod(TArray<LodBand>(), sink);
+	velocity = FIntPoint(0, 0);
+
+	ring.Reset();
+	nRingWidth = 0;
+
+	// Reset root
+	root.Reset();
+	root = nullptr;
+
+	bIsInit = false;
+	nRadius = 1;
+}
+
+template<typename T>
+TSharedPtr<TCell<T>, ESPMode::ThreadSafe> TGrid<T>::GetRoot()
+{
+	return root;
+}
+
+template<typename T>
+int TGrid<T>::GetRadius() const
+{
+	return nRadius;
+}
+
+template<typename T>
+GridStorage TGrid<T>::GetStorage() const
+{
+	return storage;
+}
+
+template<typename T>
+GridShape TGrid<T>::GetShape() const
+{
+	return shape;
+}
+
+template<typename T>
+TArray<TSharedPtr<TCell<T>, ESPMode::ThreadSafe>> TGrid<T>::GetAllCells()
+{
+	TArray<CellPtr> Cells;
+	if (!IsValid(root))
+		return Cells;
+
+	Cells.Reserve((2 * nRadius - 1) * (2 * nRadius - 1));
+	ForEachCell([&](const CellPtr& c)
+		{
+			Cells.Push(c);
+		});
+
+	return Cells;
+}
+
+template<typename T>
+template<typename F>
+void TGrid<T>::ForEachCell(F&& f) const
+{
+	if (!IsValid(root))
+		return;
+
+	FIntPoint extent(nRadius - 1, nRadius - 1);
+	ForEachCellInRect(root->GetIndex() - extent, root->GetIndex() + extent, f);
+}
+
+template<typename T>
+template<typename F>
+void TGrid<T>::ForEachCellInRect(FIntPoint min, FIntPoint max, F&& f) const
+{
+	if (!IsValid(root))
+		return;
+
+	// Whatever the storage, cells of the grid are the live cells of its area in the pool.
+	// Chunks reach past the area, so the square is cut out of them as well
+	auto center = root->GetIndex();
+	int r = nRadius - 1;
+
+	FIntPoint lo(FMath::Max(min.X, center.X - r), FMath::Max(min.Y, center.Y - r));
+	FIntPoint hi(FMath::Min(max.X, center.X + r), FMath::Min(max.Y, center.Y + r));
+
+	if (shape == GridShape::SQUARE)
+	{
+		manager.cellPool.ForEachInRect(lo, hi, f);
+		return;
+	}
+
+	manager.cellPool.ForEachInRect(lo, hi, [&](const CellPtr& c)
+		{
+			if (InArea(shape, nRadius, c->GetIndex() - center))
+				f(c);
+		});
+}
+
+template<typename T>
+template<typename F>
+void TGrid<T>::ForEachCellInRing(int inner, int outer, F&& f) const
+{
+	if (!IsValid(root))
+		return;
+
+	GridManager::ForEachRingRect(root->GetIndex(), inner, outer, [&](FIntPoint min, FIntPoint max)
+		{
+			ForEachCellInRect(min, max, f);
+		});
+}
+
+template<typename T>
+template<typename F>
+void TGrid<T>::ForEachSquareDifference(FIntPoint center, FIntPoint other, int radius, F&& f)
+{
+	auto r = radius - 1;
+	auto dt = center - other;
+
+	// Squares do not overlap
+	if (FMath::Abs(dt.X) > 2 * r || FMath::Abs(dt.Y) > 2 * r)
+	{
+		for (int x = center.X - r; x <= center.X + r; x++)
+			for (int y = center.Y - r; y <= center.Y + r; y++)
+				f(FIntPoint(x, y));
+		return;
+	}
+
+	// Columns out of the other square
+	int x0 = center.X - r;
+	int x1 = center.X + r;
+	if (dt.X > 0)
+	{
+		for (int x = other.X + r + 1; x <= x1; x++)
+			for (int y = center.Y - r; y <= center.Y + r; y++)
+				f(FIntPoint(x, y));
+		x1 = other.X + r;
+	}
+	else if (dt.X < 0)
+	{
+		for (int x = x0; x < other.X - r; x++)
+			for (int y = center.Y - r; y <= center.Y + r; y++)
+				f(FIntPoint(x, y));
+		x0 = other.X - r;
+	}
+
+	// Rows out of the other square, within the shared columns
+	if (dt.Y > 0)
+	{
+		for (int x = x0; x <= x1; x++)
+			for (int y = other.Y + r + 1; y <= center.Y + r; y++)
+				f(FIntPoint(x, y));
+	}
+	else if (dt.Y < 0)
+	{
+		for (int x = x0; x <= x1; x++)
+			for (int y = center.Y - r; y < other.Y - r; y++)
+				f(FIntPoint(x, y));
+	}
+}
+
+template<typename T>
+template<typename F>
+void TGrid<T>::ForEachDiscDifference(FIntPoint center, int radius, FIntPoint other, int otherRadius, F&& f)
+{
+	auto r = radius - 1;
+	auto otherR = otherRadius - 1;
+
+	// Half widths change by a little from row to row, so they are adjusted instead of
+	// computed from a root. The other disc's rows are one run, its width starts at 0
+	auto fit = [](int& w, int rest)
+	{
+		while (w * w > rest)
+			w--;
+		while ((w + 1) * (w + 1) <= rest)
+			w++;
+	};
+
+	int w = 0;
+	int ow = 0;
+
+	// Rows in the order cells lie in pool slabs, a row crossing the other disc
+	// has cells out of it at both ends only
+	for (int y = center.Y - r; y <= center.Y + r; y++)
+	{
+		int dy = y - center.Y;
+		fit(w, r * r + r - dy * dy);
+
+		int x0 = center.X - w;
+		int x1 = center.X + w;
+
+		int ody = y - other.Y;
+		if (otherR < 0 || FMath::Abs(ody) > otherR)
+		{
+			for (int x = x0; x <= x1; x++)
+				f(FIntPoint(x, y));
+			continue;
+		}
+
+		fit(ow, otherR * otherR + otherR - ody * ody);
+
+		for (int x = x0; x <= FMath::Min(x1, other.X - ow - 1); x++)
+			f(FIntPoint(x, y));
+		for (int x = FMath::Max(x0, other.X + ow + 1); x <= x1; x++)
+			f(FIntPoint(x, y));
+	}
+}
+
+template<typename T>
+template<typename F>
+void TGrid<T>::ForEachAreaDifference(FIntPoint center, FIntPoint other, F&& f) const
+{
+	if (shape == GridShape::SQUARE)
+		ForEachSquareDifference(center, other, nRadius, f);
+	else
+		ForEachDiscDifference(center, nRadius, other, nRadius, f);
+}
+
+template<typename T>
+TSharedPtr<TCell<T>, ESPMode::ThreadSafe> TGrid<T>::FindCellByIndex(FIntPoint index)
+{
+	if (!IsValid(root))
+		return nullptr;
+
+	// Check if index in grid field
+	nNumLookups++;
+	if (!IsCurrent(index))
+		return nullptr;
+
+	// Cells are shared between grids, so the manager index knows all of them
+	auto c = storage == GridStorage::RING ? ring[RingSlot(index)] : manager.FindCell(index);
+	if (!IsValid(c))
+		throw "The current grid has lost a cell";
+
+	return c;
+}
+
+template<typename T>
+TSharedPtr<TCell<T>, ESPMode::ThreadSafe> TGrid<T>::FindCellByIndex(int x, int y)
+{
+	return FindCellByIndex(FIntPoint(x, y));
+}
+
+template<typename T>
+TSharedPtr<TCell<T>, ESPMode::ThreadSafe> TGrid<T>::AcquireCell(FIntPoint index, Sink& sink)
+{
+	// Cell could be already loaded by another grid
+	CellPtr c = manager.FindCell(index);
+
+	if (IsValid(c))
+	{
+		// Only prefetch bands held it so far
+		if (c->IsSpeculative())
+			sink.OnPromoted(c);
+
+		c->NumOwners()++;
+		metrics.numShared++;
+		return c;
+	}
+
+	bool bRevived = false;
+	c = manager.cellPool.Acquire(index, &bRevived);
+	metrics.numCreated++;
+
+	if (bRevived)
+		sink.OnRevived(c);
+	else
+		sink.OnCreated(c);
+
+	return c;
+}
+
+template<typename T>
+void TGrid<T>::ReleaseCell(CellPtr c, Sink& sink)
+{
+	if (!IsValid(c))
+		return;
+
+	// Cell is still used by other grids, so just forget about it
+	if (c->NumOwners()-- > 1)
+		return;
+
+	// Hand data over to the sink, unless the pool keeps it
+	metrics.numReleased++;
+	manager.cellPool.Release(c, [&](T&& data)
+		{
+			sink.OnDeleted(MoveTemp(data));
+		});
+}
+
+template<typename T>
+TArray<TSharedPtr<TCell<T>, ESPMode::ThreadSafe>> TGrid<T>::Prefetch(FIntPoint center, FIntPoint step, Sink& sink)
+{
+	// A jump tells nothing about where the grid goes next
+	velocity = FMath::Abs(step.X) <= nRadius && FMath::Abs(step.Y) <= nRadius ? step : FIntPoint(0, 0);
+
+	TArray<CellPtr> band;
+	if (nPrefetchRows <= 0 || velocity == FIntPoint(0, 0))
+		return band;
+
+	// Box swept by the square over the next rows, without the square itself.
+	// A disc takes only the discs it passes through, not the corners of the box
+	auto r = nRadius - 1;
+	auto reach = FIntPoint(velocity.X * nPrefetchRows, velocity.Y * nPrefetchRows);
+
+	auto ahead = [&](FIntPoint index)
+	{
+		if (shape == GridShape::SQUARE)
+			return true;
+
+		for (int k = 1; k <= nPrefetchRows; k++)
+			if (InArea(shape, nRadius, index - center - FIntPoint(velocity.X * k, velocity.Y * k)))
+				return true;
+
+		return false;
+	};
+
+	for (int x = center.X - r + FMath::Min(reach.X, 0); x <= center.X + r + FMath::Max(reach.X, 0); x++)
+		for (int y = center.Y - r + FMath::Min(reach.Y, 0); y <= center.Y + r + FMath::Max(reach.Y, 0); y++)
+		{
+			if (InArea(shape, nRadius, FIntPoint(x - center.X, y - center.Y)) || !ahead(FIntPoint(x, y)))
+				continue;
+
+			FIntPoint index(x, y);
+			CellPtr c = manager.FindCell(index);
+
+			if (IsValid(c))
+			{
+				c->NumOwners()++;
+				metrics.numShared++;
+			}
+			else
+			{
+				bool bRevived = false;
+				c = manager.cellPool.Acquire(index, &bRevived);
+				metrics.numCreated++;
+
+				if (bRevived)
+					sink.OnRevived(c);
+				else
+					sink.OnCreated(c);
+			}
+
+			c->nNumSpeculative++;
+			band.Push(c);
+		}
+
+	return band;
+}
+
+template<typename T>
+void TGrid<T>::DropPrefetched(Sink& sink)
+{
+	for (auto& cc : prefetched)
+	{
+		cc->nNumSpeculative--;
+		ReleaseCell(cc, sink);
+	}
+
+	prefetched.Reset();
+}
+
+template<typename T>
+TArray<TSharedPtr<TCell<T>, ESPMode::ThreadSafe>> TGrid<T>::Retain(FIntPoint from, FIntPoint to)
+{
+	TArray<CellPtr> kept;
+	if (nHysteresis <= 0)
+		return kept;
+
+	auto keep = [&](FIntPoint index)
+	{
+		// Out of the grid, but not too far from it
+		return !InArea(shape, nRadius, index - to) && InArea(shape, nRadius + nHysteresis, index - to);
+	};
+
+	for (auto& cc : retained)
+		if (keep(cc->GetIndex()))
+		{
+			cc->NumOwners()++;
+			kept.Push(cc);
+		}
+
+	// Leaving cells are still owned by the grid, so they are alive
+	ForEachAreaDifference(from, to, [&](FIntPoint index)
+		{
+			if (!keep(index))
+				return;
+
+			CellPtr c = manager.FindCell(index);
+			if (IsValid(c))
+			{
+				c->NumOwners()++;
+				kept.Push(c);
+			}
+		});
+
+	return kept;
+}
+
+template<typename T>
+void TGrid<T>::DropRetained(Sink& sink)
+{
+	for (auto& cc : retained)
+		ReleaseCell(cc, sink);
+
+	retained.Reset();
+}
+
+template<typename T>
+void TGrid<T>::SetHysteresis(int rows)
+{
+	nHysteresis = FMath::Max(rows, 0);
+}
+
+template<typename T>
+int TGrid<T>::GetHysteresis() const
+{
+	return nHysteresis;
+}
+
+template<typename T>
+const TArray<TSharedPtr<TCell<T>, ESPMode::ThreadSafe>>& TGrid<T>::GetRetainedCells() const
+{
+	return retained;
+}
+
+template<typename T>
+GridMetrics TGrid<T>::GetMetrics() const
+{
+	GridMetrics snapshot = metrics;
+	snapshot.numLookups = nNumLookups;
+
+	return snapshot;
+}
+
+template<typename T>
+void TGrid<T>::ResetMetrics()
+{
+	metrics = GridMetrics();
+	nNumLookups = 0;
+}
+
+template<typename T>
+void TGrid<T>::SetPrefetch(int rows)
+{
+	nPrefetchRows = FMath::Max(rows, 0);
+}
+
+template<typename T>
+int TGrid<T>::GetPrefetch() const
+{
+	return nPrefetchRows;
+}
+
+template<typename T>
+FIntPoint TGrid<T>::GetVelocity() const
+{
+	return velocity;
+}
+
+template<typename T>
+const TArray<TSharedPtr<TCell<T>, ESPMode::ThreadSafe>>& TGrid<T>::GetPrefetchedCells() const
+{
+	return prefetched;
+}
+
+template<typename T>
+void TGrid<T>::ChunkRect(FIntPoint center, int radius, FIntPoint& min, FIntPoint& max)
+{
+	auto r = radius - 1;
+	min = TCellPool<T>::GetRegion(center - FIntPoint(r, r));
+	max = TCellPool<T>::GetRegion(center + FIntPoint(r, r));
+}
+
+template<typename T>
+void TGrid<T>::AcquireChunks(FIntPoint center, int radius, FIntPoint other, int otherRadius, Sink& sink)
+{
+	FIntPoint min, max, otherMin, otherMax(-1, -1);
+	ChunkRect(center, radius, min, max);
+	if (otherRadius > 0)
+		ChunkRect(other, otherRadius, otherMin, otherMax);
+
+	TArray<CellPtr> created;
+	TArray<CellPtr> promoted;
+	TArray<CellPtr> revived;
+
+	for (int y = min.Y; y <= max.Y; y++)
+		for (int x = min.X; x <= max.X; x++)
+		{
+			// Corner chunks of a disc hold none of its cells
+			if (shape == GridShape::DISC && !ChunkInArea(FIntPoint(x, y), center, radius))
+				continue;
+
+			// Already owned through the other area
+			if (otherRadius > 0 && x >= otherMin.X && x <= otherMax.X && y >= otherMin.Y && y <= otherMax.Y
+				&& ChunkInArea(FIntPoint(x, y), other, otherRadius))
+				continue;
+
+			created.Reset();
+			promoted.Reset();
+			revived.Reset();
+			manager.cellPool.AcquireRegion(FIntPoint(x, y), created, promoted, revived);
+			metrics.numCreated += created.Num() + revived.Num();
+			metrics.numShared += TCellPool<T>::SlabSize - created.Num() - revived.Num();
+
+			for (auto& cc : promoted)
+				sink.OnPromoted(cc);
+			for (auto& cc : created)
+				sink.OnCreated(cc);
+			for (auto& cc : revived)
+				sink.OnRevived(cc);
+		}
+}
+
+template<typename T>
+void TGrid<T>::ReleaseChunks(FIntPoint center, int radius, FIntPoint other, int otherRadius, Sink& sink)
+{
+	FIntPoint min, max, otherMin, otherMax(-1, -1);
+	ChunkRect(center, radius, min, max);
+	if (otherRadius > 0)
+		ChunkRect(other, otherRadius, otherMin, otherMax);
+
+	for (int y = min.Y; y <= max.Y; y++)
+		for (int x = min.X; x <= max.X; x++)
+		{
+			if (shape == GridShape::DISC && !ChunkInArea(FIntPoint(x, y), center, radius))
+				continue;
+
+			// Still owned through the other area
+			if (otherRadius > 0 && x >= otherMin.X && x <= otherMax.X && y >= otherMin.Y && y <= otherMax.Y
+				&& ChunkInArea(FIntPoint(x, y), other, otherRadius))
+				continue;
+
+			metrics.numReleased += manager.cellPool.ReleaseRegion(FIntPoint(x, y), [&](T&& data)
+				{
+					sink.OnDeleted(MoveTemp(data));
+				});
+		}
+}
+
+template<typename T>
+bool TGrid<T>::ChunkInArea(FIntPoint region, FIntPoint center, int radius) const
+{
+	// Cell of the region nearest to the center
+	auto origin = FIntPoint(region.X * TCellPool<T>::SlabSide, region.Y * TCellPool<T>::SlabSide);
+	auto nearest = FIntPoint(
+		FMath::Clamp(center.X, origin.X, origin.X + TCellPool<T>::SlabSide - 1),
+		FMath::Clamp(center.Y, origin.Y, origin.Y + TCellPool<T>::SlabSide - 1));
+
+	return InArea(shape, radius, nearest - center);
+}
+
+template<typename T>
+int TGrid<T>::GetReach() const
+{
+	// Chunk edges are at most one slab side past the square
+	int reach = nRadius - 1;
+	if (storage == GridStorage::CHUNKED)
+		reach += TCellPool<T>::SlabSide - 1;
+
+	// So are edges of aggregates past their bands
+	for (int i = 0; i < lodRadii.Num(); i++)
+		reach = FMath::Max(reach, lodRadii[i] - 1 + (1 << (i + 1)) - 1);
+
+	// Held bands could be wider until the new radii take effect
+	FIntPoint center = IsValid(root) ? root->GetIndex() : FIntPoint(0, 0);
+	for (int i = 0; i < lodBands.Num(); i++)
+	{
+		int side = 1 << (i + 1);
+		FIntPoint lo = center - FIntPoint(lodBands[i].outerMin.X * side, lodBands[i].outerMin.Y * side);
+		FIntPoint hi = FIntPoint((lodBands[i].outerMax.X + 1) * side, (lodBands[i].outerMax.Y + 1) * side) - center - FIntPoint(1, 1);
+
+		reach = FMath::Max(reach, FMath::Max(FMath::Max(lo.X, lo.Y), FMath::Max(hi.X, hi.Y)));
+	}
+
+	return reach;
+}
+
+template<typename T>
+int TGrid<T>::RingSlot(FIntPoint index) const
+{
+	// Wrap negative indices too
+	int x = ((index.X % nRingWidth) + nRingWidth) % nRingWidth;
+	int y = ((index.Y % nRingWidth) + nRingWidth) % nRingWidth;
+
+	return y * nRingWidth + x;
+}
+
+template<typename T>
+void TGrid<T>::RingRebuild(FIntPoint center, int radius, Sink& sink)
+{
+	radius = FMath::Clamp(radius, nLimMin, nLimMax);
+
+	TArray<CellPtr> oldRing = MoveTemp(ring);
+	FIntPoint oldCenter = IsValid(root) ? root->GetIndex() : center;
+	int oldRadius = nRadius;
+	int oldWidth = nRingWidth;
+
+	nRadius = radius;
+	nRingWidth = radius * 2 - 1;
+
+	ring.SetNum(nRingWidth * nRingWidth);
+
+	// Take new cells first, so cells of both areas never drop to zero owners.
+	// Slots out of a disc stay empty
+	for (int y = center.Y - (radius - 1); y <= center.Y + (radius - 1); y++)
+		for (int x = center.X - RowExtent(shape, radius, y - center.Y); x <= center.X + RowExtent(shape, radius, y - center.Y); x++)
+		{
+			FIntPoint index(x, y);
+
+			if (oldRing.Num() && InArea(shape, oldRadius, index - oldCenter))
+			{
+				int ox = ((x % oldWidth) + oldWidth) % oldWidth;
+				int oy = ((y % oldWidth) + oldWidth) % oldWidth;
+
+				ring[RingSlot(index)] = oldRing[oy * oldWidth + ox];
+				oldRing[oy * oldWidth + ox] = nullptr;
+			}
+			else
+				ring[RingSlot(index)] = AcquireCell(index, sink);
+		}
+
+	// Whatever left in the old ring is out of the area now
+	for (auto cc : oldRing)
+		ReleaseCell(cc, sink);
+
+	root = ring[RingSlot(center)];
+}
+
+template<typename T>
+bool TGrid<T>::LodBand::Contains(FIntPoint c) const
+{
+	if (c.X < outerMin.X || c.X > outerMax.X || c.Y < outerMin.Y || c.Y > outerMax.Y)
+		return false;
+
+	return c.X < innerMin.X || c.X > innerMax.X || c.Y < innerMin.Y || c.Y > innerMax.Y;
+}
+
+template<typename T>
+bool TGrid<T>::LodBand::operator==(const LodBand& other) const
+{
+	return outerMin == other.outerMin && outerMax == other.outerMax &&
+		innerMin == other.innerMin && innerMax == other.innerMax;
+}
+
+template<typename T>
+void TGrid<T>::SetLod(const TArray<int>& radii)
+{
+	int levels = FMath::Min(radii.Num(), (int)GridManager::MaxLodLevels);
+
+	lodRadii.Reset();
+	for (int i = 0; i < levels; i++)
+		lodRadii.Push(FMath::Clamp(radii[i], nLimMin, nLimMax << (i + 1)));
+
+	manager.ReserveLodLevels(levels);
+}
+
+template<typename T>
+const TArray<int>& TGrid<T>::GetLod() const
+{
+	return lodRadii;
+}
+
+template<typename T>
+TArray<TSharedPtr<TCell<T>, ESPMode::ThreadSafe>> TGrid<T>::GetLodCells(int level) const
+{
+	TArray<CellPtr> cells;
+	if (level < 1 || level > lodBands.Num())
+		return cells;
+
+	auto& pool = *manager.lodPools[level - 1];
+	ForEachBandDifference(lodBands[level - 1], nullptr, [&](FIntPoint index)
+		{
+			cells.Push(pool.Find(index));
+		});
+
+	return cells;
+}
+
+template<typename T>
+TSharedPtr<TCell<T>, ESPMode::ThreadSafe> TGrid<T>::FindLodCell(int level, FIntPoint index) const
+{
+	if (level < 1 || level > lodBands.Num())
+		return nullptr;
+
+	// Floor division, negative indices included
+	FIntPoint coarse(index.X >> level, index.Y >> level);
+	if (!lodBands[level - 1].Contains(coarse))
+		return nullptr;
+
+	return manager.lodPools[level - 1]->Find(coarse);
+}
+
+template<typename T>
+TArray<typename TGrid<T>::LodBand> TGrid<T>::MakeLodBands(FIntPoint center) const
+{
+	TArray<LodBand> bands;
+	if (shape != GridShape::SQUARE)
+		return bands;
+
+	bands.Reserve(lodRadii.Num());
+
+	// Finer square in full cells, the grid itself for the first band
+	FIntPoint lo = center - FIntPoint(nRadius - 1, nRadius - 1);
+	FIntPoint hi = center + FIntPoint(nRadius - 1, nRadius - 1);
+
+	for (int i = 0; i < lodRadii.Num(); i++)
+	{
+		int shift = i + 1;
+		int side = 1 << shift;
+		int r = lodRadii[i] - 1;
+
+		LodBand band;
+		band.outerMin = FIntPoint((center.X - r) >> shift, (center.Y - r) >> shift);
+		band.outerMax = FIntPoint((center.X + r) >> shift, (center.Y + r) >> shift);
+
+		// Aggregates wholly under the finer square
+		band.innerMin = FIntPoint((lo.X + side - 1) >> shift, (lo.Y + side - 1) >> shift);
+		band.innerMax = FIntPoint(((hi.X + 1) >> shift) - 1, ((hi.Y + 1) >> shift) - 1);
+
+		bands.Push(band);
+
+		lo = center - FIntPoint(r, r);
+		hi = center + FIntPoint(r, r);
+	}
+
+	return bands;
+}
+
+template<typename T>
+template<typename F>
+void TGrid<T>::ForEachBandDifference(const LodBand& a, const LodBand* b, F&& f)
+{
+	// Row of a band is up to two spans, the inner rectangle cuts it in the middle
+	auto rowSpans = [](const LodBand& band, int y, FIntPoint spans[2]) -> int
+	{
+		if (y < band.outerMin.Y || y > band.outerMax.Y)
+			return 0;
+
+		bool bCut = y >= band.innerMin.Y && y <= band.innerMax.Y && band.innerMin.X <= band.innerMax.X;
+		if (!bCut)
+		{
+			spans[0] = FIntPoint(band.outerMin.X, band.outerMax.X);
+			return 1;
+		}
+
+		int num = 0;
+		if (band.outerMin.X < band.innerMin.X)
+			spans[num++] = FIntPoint(band.outerMin.X, FMath::Min(band.outerMax.X, band.innerMin.X - 1));
+		if (band.outerMax.X > band.innerMax.X)
+			spans[num++] = FIntPoint(FMath::Max(band.outerMin.X, band.innerMax.X + 1), band.outerMax.X);
+
+		return num;
+	};
+
+	FIntPoint spans[2];
+	FIntPoint skip[2];
+
+	for (int y = a.outerMin.Y; y <= a.outerMax.Y; y++)
+	{
+		int num = rowSpans(a, y, spans);
+		int numSkip = b ? rowSpans(*b, y, skip) : 0;
+
+		for (int i = 0; i < num; i++)
+			for (int x = spans[i].X; x <= spans[i].Y; x++)
+			{
+				// Jump over the part of the row b has
+				for (int j = 0; j < numSkip; j++)
+					if (x >= skip[j].X && x <= skip[j].Y)
+						x = skip[j].Y + 1;
+
+				if (x > spans[i].Y)
+					break;
+
+				f(FIntPoint(x, y));
+			}
+	}
+}
+
+template<typename T>
+void TGrid<T>::AcquireLod(const TArray<LodBand>& bands, Sink& sink)
+{
+	for (int i = 0; i < bands.Num(); i++)
+	{
+		const LodBand* held = i < lodBands.Num() ? &lodBands[i] : nullptr;
+
+		// Coarse bands change only once in a few steps
+		if (held && *held == bands[i])
+			continue;
+
+		ForEachBandDifference(bands[i], held, [&](FIntPoint index)
+			{
+				AcquireLodCell(i + 1, index, sink);
+			});
+	}
+}
+
+template<typename T>
+void TGrid<T>::ReleaseLod(const TArray<LodBand>& bands, Sink& sink)
+{
+	for (int i = 0; i < lodBands.Num(); i++)
+	{
+		const LodBand* kept = i < bands.Num() ? &bands[i] : nullptr;
+
+		if (kept && *kept == lodBands[i])
+			continue;
+
+		ForEachBandDifference(lodBands[i], kept, [&](FIntPoint index)
+			{
+				ReleaseLodCell(i + 1, index, sink);
+			});
+	}
+
+	lodBands = bands;
+}
+
+template<typename T>
+void TGrid<T>::UpdateLod(FIntPoint center, Sink& sink)
+{
+	if (!lodRadii.Num() && !lodBands.Num())
+		return;
+
+	TArray<LodBand> bands = MakeLodBands(center);
+	AcquireLod(bands, sink);
+	ReleaseLod(bands, sink);
+}
+
+template<typename T>
+void TGrid<T>::AcquireLodCell(int level, FIntPoint index, Sink& sink)
+{
+	auto& pool = *manager.lodPools[level - 1];
+
+	// Aggregate could be already held by another grid
+	CellPtr c = pool.Find(index);
+
+	if (IsValid(c))
+	{
+		c->NumOwners()++;
+		return;
+	}
+
+	sink.OnLodCreated(pool.Acquire(index));
+}
+
+template<typename T>
+void TGrid<T>::ReleaseLodCell(int level, FIntPoint index, Sink& sink)
+{
+	auto& pool = *manager.lodPools[level - 1];
+
+	CellPtr c = pool.Find(index);
+	if (!IsValid(c) || c->NumOwners()-- > 1)
+		return;
+
+	pool.Release(c, [&](T&& data)
+		{
+			sink.OnLodDeleted(level, MoveTemp(data));
+		});
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+TCell<T>::TCell() : index(0, 0) {}
+
+template<typename T>
+TSharedPtr<TCell<T>, ESPMode::ThreadSafe> TCell<T>::MakeCell(FIntPoint index)
+{
+	TCell* new_cell = new TCell();
+	new_cell->SetIndex(index.X, index.Y);
+	new_cell->bIsValid = true;
+
+	return MakeShareable(new_cell);
+}
+
+template<typename T>
+FIntPoint TCell<T>::GetIndex() const
+{
+	return index;
+}
+
+template<typename T>
+void TCell<T>::SetIndex(int x, int y)
+{
+	index = FIntPoint(x, y);
+}
+
+template<typename T>
+void TCell<T>::SetIndex(FIntPoint pos)
+{
+	SetIndex(pos.X, pos.Y);
+}
+
+template<typename T>
+T& TCell<T>::GetData()
+{
+	return Data;
+}
+
+template<typename T>
+const T& TCell<T>::GetData() const
+{
+	return Data;
+}
+
+template<typename T>
+std::atomic<size_t>& TCell<T>::NumOwners()
+{
+	return nNumOwners;
+}
+
+template<typename T>
+bool TCell<T>::IsSpeculative() const
+{
+	auto spec = nNumSpeculative.load();
+	return spec > 0 && spec == nNumOwners;
+}
+
+template<typename T>
+bool TCell<T>::IsValid() const
+{
+	return bIsValid;
+}
+
+template<typename T>
+CellState TCell<T>::GetState() const
+{
+	return state;
+}
+
+template<typename T>
+int TCell<T>::GetLevel() const
+{
+	return nLevel;
+}
+
+template<typename T>
+uint64 TCell<T>::GetGeneration() const
+{
+	return nGeneration;
+}
+
+template<typename T>
+void TCell<T>::Reset()
+{
+	// Payload is taken back by the pool on release
+	bIsValid = false;
+	bIsReseted = true;
+}
+
+template<typename T>
+const TSharedPtr<TCell<T>, ESPMode::ThreadSafe>& TCell<T>::GetN(Direction dir) const
+{
+	static const ptr none = nullptr;
+
+	// Same order as Direction
+	static const FIntPoint offsets[8] = {
+		FIntPoint( 1,  0),	// FRONT
+		FIntPoint(-1,  0),	// BACK
+		FIntPoint( 0, -1),	// LEFT
+		FIntPoint( 0,  1),	// RIGHT
+		FIntPoint( 1,  1),	// FRONT_RIGHT
+		FIntPoint(-1,  1),	// BACK_RIGHT
+		FIntPoint(-1, -1),	// BACK_LEFT
+		FIntPoint( 1, -1)	// FRONT_LEFT
+	};
+
+	auto idx = static_cast<uint8_t>(dir);
+	if (!pool || idx >= 8)
+		return none;
+
+	// Neighbour is whatever cell is alive next to this one
+	return pool->Find(index + offsets[idx]);
+}
+
+////////////////////////////////////////////////////////////////
+
+template<typename T>
+TGridManager<T>::TGridManager() {}
+
+template<typename T>
+TSharedPtr<TGrid<T>> TGridManager<T>::CreateGrid(GridStorage mode, GridShape shape)
+{
+	GridPtr New = MakeShareable(new Grid(*this, mode, shape));
+	// New->Init(x, y, num_waves);
+
+	rootGrids.Push(New);
+	return New;
+}
+
+template<typename T>
+bool TGridManager<T>::DestroyGrid(GridPtr g)
+{
+	Delivered delivered;
+	return DestroyGrid(g, delivered);
+}
+
+template<typename T>
+bool TGridManager<T>::DestroyGrid(GridPtr g, Sink& sink)
+{
+	// Cells of a forgotten grid would never be released otherwise
+	if (g.IsValid())
+		g->Clear(sink);
+
+	if (!rootGrids.Remove(g))
+		return false;
+
+	// Work of the grid still counts
+	metrics.Append(g->GetMetrics());
+	return true;
+}
+
+template<typename T>
+CellStats TGridManager<T>::GetCellStats() const
+{
+	return cellPool.GetStats();
+}
+
+template<typename T>
+template<typename F>
+void TGridManager<T>::ForEachCell(F&& f) const
+{
+	cellPool.ForEachLive(f);
+}
+
+template<typename T>
+template<typename F>
+void TGridManager<T>::ForEachCellInRect(FIntPoint min, FIntPoint max, F&& f) const
+{
+	cellPool.ForEachInRect(min, max, f);
+}
+
+template<typename T>
+template<typename F>
+void TGridManager<T>::ForEachCellInRing(FIntPoint center, int inner, int outer, F&& f) const
+{
+	ForEachRingRect(center, inner, outer, [&](FIntPoint min, FIntPoint max)
+		{
+			cellPool.ForEachInRect(min, max, f);
+		});
+}
+
+template<typename T>
+template<typename F>
+void TGridManager<T>::ForEachRingRect(FIntPoint center, int inner, int outer, F&& visit)
+{
+	inner = FMath::Max(inner, 0);
+	if (outer < inner)
+		return;
+
+	if (inner == 0)
+	{
+		visit(center - FIntPoint(outer, outer), center + FIntPoint(outer, outer));
+		return;
+	}
+
+	// Rows above and below the hole span the whole ring, columns beside it only the hole
+	visit(FIntPoint(center.X - outer, center.Y - outer), FIntPoint(center.X + outer, center.Y - inner));
+	visit(FIntPoint(center.X - outer, center.Y - inner + 1), FIntPoint(center.X - inner, center.Y + inner - 1));
+	visit(FIntPoint(center.X + inner, center.Y - inner + 1), FIntPoint(center.X + outer, center.Y + inner - 1));
+	visit(FIntPoint(center.X - outer, center.Y + inner), FIntPoint(center.X + outer, center.Y + outer));
+}
+
+template<typename T>
+TSharedPtr<TCell<T>, ESPMode::ThreadSafe> TGridManager<T>::FindLodCell(int level, FIntPoint index) const
+{
+	if (level < 1 || level > lodPools.Num())
+		return nullptr;
+
+	return lodPools[level - 1]->Find(index);
+}
+
+template<typename T>
+CellStats TGridManager<T>::GetLodStats(int level) const
+{
+	if (level < 1 || level > lodPools.Num())
+		return CellStats();
+
+	return lodPools[level - 1]->GetStats();
+}
+
+template<typename T>
+void TGridManager<T>::ReserveLodLevels(int levels)
+{
+	// Aggregates have no payload hooks, loader or cache of their own
+	while (lodPools.Num() < levels)
+	{
+		auto pool = MakeUnique<TCellPool<T>>();
+		pool->SetLevel(lodPools.Num() + 1);
+		pool->SetThreadSafe(bConcurrent);
+
+		lodPools.Push(MoveTemp(pool));
+	}
+}
+
+template<typename T>
+GridMetrics TGridManager<T>::GetMetrics() const
+{
+	GridMetrics snapshot = metrics;
+	for (auto& g : rootGrids)
+		snapshot.Append(g->GetMetrics());
+
+	return snapshot;
+}
+
+template<typename T>
+void TGridManager<T>::ResetMetrics()
+{
+	metrics = GridMetrics();
+	for (auto& g : rootGrids)
+		g->ResetMetrics();
+}
+
+template<typename T>
+void TGridManager<T>::SetCellCache(int maxCells, int64 maxBytes, TFunction<int64(const T&)> payloadSize)
+{
+	cellPool.SetCache(maxCells, maxBytes, MoveTemp(payloadSize));
+}
+
+template<typename T>
+void TGridManager<T>::EmptyCellCache(Sink& sink)
+{
+	cellPool.EmptyCache([&](T&& data)
+		{
+			sink.OnDeleted(MoveTemp(data));
+		});
+}
+
+template<typename T>
+int TGridManager<T>::NumCachedCells() const
+{
+	return cellPool.NumCached();
+}
+
+template<typename T>
+TSharedPtr<TCell<T>, ESPMode::ThreadSafe> TGridManager<T>::FindCell(FIntPoint index) const
+{
+	return cellPool.Find(index);
+}
+
+template<typename T>
+TSharedPtr<TCell<T>, ESPMode::ThreadSafe> TGridManager<T>::FindCell(int x, int y) const
+{
+	return FindCell(FIntPoint(x, y));
+}
+
+template<typename T>
+void TGridManager<T>::MoveAll(TArrayView<Move> moves, Sink& sink)
+{
+	ScopedLatency timer(metrics.latency[(int)GridOp::MOVE_ALL], bTiming);
+
+	TArray<MovePlan> plans;
+	plans.Reserve(moves.Num());
+
+	nMoveStamp++;
+	for (const Move& m : moves)
+	{
+		Grid* g = m.grid.Get();
+		if (!g || !g->IsInit() || g->nMoveStamp == nMoveStamp)
+			continue;
+
+		g->nMoveStamp = nMoveStamp;
+
+		auto from = g->root->GetIndex();
+		if (from != m.target)
+			plans.Push({ g, from, m.target });
+	}
+
+	// Bands and retained cells are taken before any grid moves and dropped after all of them did
+	TArray<TArray<CellPtr>> ahead;
+	TArray<TArray<CellPtr>> kept;
+	ahead.SetNum(plans.Num());
+	kept.SetNum(plans.Num());
+	for (int i = 0; i < plans.Num(); i++)
+	{
+		ahead[i] = plans[i].grid->Prefetch(plans[i].to, plans[i].to - plans[i].from, sink);
+		kept[i] = plans[i].grid->Retain(plans[i].from, plans[i].to);
+	}
+
+	if (!bConcurrent || plans.Num() < 2)
+		MovePlans(plans, sink);
+	else
+	{
+		TArray<TArray<MovePlan>> groups = GroupPlans(plans);
+
+		// Groups never share cells, so each one runs on its own worker with its own output
+		TArray<Delivered> results;
+		results.SetNum(groups.Num());
+
+		ParallelFor(groups.Num(), [&](int32 idx)
+			{
+				MovePlans(groups[idx], results[idx]);
+			});
+
+		for (auto& result : results)
+		{
+			for (auto& cc : result.created)
+				sink.OnCreated(cc);
+
+			for (auto& cc : result.promoted)
+				sink.OnPromoted(cc);
+
+			for (auto& cc : result.revived)
+				sink.OnRevived(cc);
+
+			for (auto& data : result.deleted)
+				sink.OnDeleted(MoveTemp(data));
+
+			for (auto& cc : result.lodCreated)
+				sink.OnLodCreated(cc);
+
+			for (auto& lod : result.lodDeleted)
+				sink.OnLodDeleted(lod.Key, MoveTemp(lod.Value));
+		}
+	}
+
+	for (int i = 0; i < plans.Num(); i++)
+	{
+		plans[i].grid->DropPrefetched(sink);
+		plans[i].grid->prefetched = MoveTemp(ahead[i]);
+
+		plans[i].grid->DropRetained(sink);
+		plans[i].grid->retained = MoveTemp(kept[i]);
+	}
+}
+
+template<typename T>
+void TGridManager<T>::MovePlans(TArrayView<MovePlan> plans, Sink& sink)
+{
+	// Take entering cells of every grid first, so a cell passed from one grid
+	// to another never drops to zero owners on the way
+	for (auto& p : plans)
+	{
+		p.grid->AcquireLod(p.grid->MakeLodBands(p.to), sink);
+
+		if (p.grid->storage == GridStorage::CHUNKED)
+		{
+			p.grid->AcquireChunks(p.to, p.grid->nRadius, p.from, p.grid->nRadius, sink);
+			continue;
+		}
+
+		p.grid->ForEachAreaDifference(p.to, p.from, [&](FIntPoint index)
+			{
+				p.grid->AcquireCell(index, sink);
+			});
+	}
+
+	// Then drop leaving cells, only cells nobody took are released
+	for (auto& p : plans)
+	{
+		Grid* g = p.grid;
+
+		if (g->storage == GridStorage::CHUNKED)
+			g->ReleaseChunks(p.from, g->nRadius, p.to, g->nRadius, sink);
+		else
+			g->ForEachAreaDifference(p.from, p.to, [&](FIntPoint index)
+				{
+					g->ReleaseCell(cellPool.Find(index), sink);
+				});
+
+		// Entering cells take slots of the leaving ones, a disc can leave some slots empty
+		if (g->storage == GridStorage::RING)
+		{
+			if (g->shape == GridShape::DISC)
+				g->ForEachAreaDifference(p.from, p.to, [&](FIntPoint index)
+					{
+						g->ring[g->RingSlot(index)] = nullptr;
+					});
+
+			g->ForEachAreaDifference(p.to, p.from, [&](FIntPoint index)
+				{
+					g->ring[g->RingSlot(index)] = cellPool.Find(index);
+				});
+		}
+
+		g->root = cellPool.Find(p.to);
+
+		g->ReleaseLod(g->MakeLodBands(p.to), sink);
+	}
+}
+
+template<typename T>
+TArray<TArray<typename TGridManager<T>::MovePlan>> TGridManager<T>::GroupPlans(const TArray<MovePlan>& plans)
+{
+	// Union-find over plans, plans touching the same cells end up in one set
+	TArray<int> parent;
+	parent.SetNum(plans.Num());
+	for (int i = 0; i < plans.Num(); i++)
+		parent[i] = i;
+
+	auto findSet = [&](int i)
+	{
+		while (parent[i] != i)
+			i = parent[i] = parent[parent[i]];
+		return i;
+	};
+
+	// A plan touches cells of its old and new squares only
+	auto overlaps = [](const MovePlan& a, const MovePlan& b)
+	{
+		int reach = a.grid->GetReach() + b.grid->GetReach();
+		auto hit = [&](FIntPoint p, FIntPoint q)
+		{
+			return FMath::Abs(p.X - q.X) <= reach && FMath::Abs(p.Y - q.Y) <= reach;
+		};
+
+		return hit(a.from, b.from) || hit(a.from, b.to) || hit(a.to, b.from) || hit(a.to, b.to);
+	};
+
+	// Only plans sharing a bucket could overlap
+	TMap<FIntPoint, TArray<int>> buckets;
+	for (int i = 0; i < plans.Num(); i++)
+	{
+		auto& p = plans[i];
+		int r = p.grid->GetReach();
+		metrics.numGroupedPlans++;
+
+		for (FIntPoint c : { p.from, p.to })
+			for (int bx = (c.X - r) >> BucketShift; bx <= (c.X + r) >> BucketShift; bx++)
+				for (int by = (c.Y - r) >> BucketShift; by <= (c.Y + r) >> BucketShift; by++)
+				{
+					auto& bucket = buckets.FindOrAdd(FIntPoint(bx, by));
+					for (int j : bucket)
+					{
+						if (findSet(i) == findSet(j))
+							continue;
+
+						metrics.numOverlapChecks++;
+						if (overlaps(p, plans[j]))
+							parent[findSet(i)] = findSet(j);
+					}
+
+					if (!bucket.Num() || bucket.Last() != i)
+						bucket.Push(i);
+				}
+	}
+
+	TArray<TArray<MovePlan>> groups;
+	TMap<int, int> setToGroup;
+	for (int i = 0; i < plans.Num(); i++)
+	{
+		int set = findSet(i);
+
+		auto found = setToGroup.Find(set);
+		int groupIdx = found ? *found : setToGroup.Add(set, groups.Emplace());
+
+		groups[groupIdx].Push(plans[i]);
+	}
+
+	return groups;
+}
+
+template<typename T>
+void TGridManager<T>::SetConcurrent(bool bEnable)
+{
+	bConcurrent = bEnable;
+	cellPool.SetThreadSafe(bEnable);
+
+	for (auto& pool : lodPools)
+		pool->SetThreadSafe(bEnable);
+}
+
+template<typename T>
+bool TGridManager<T>::IsConcurrent() const
+{
+	return bConcurrent;
+}
+
+template<typename T>
+TDelivered<T> TGridManager<T>::MoveAll(TArrayView<Move> moves)
+{
+	Delivered delivered;
+	MoveAll(moves, delivered);
+
+	if constexpr (TIsPointer<T>::Value)
+		delivered.deleted.RemoveAll([&](const T& cc) { return cc == nullptr; });
+
+	return delivered;
+}
+
+template<typename T>
+void TGridManager<T>::SetPayloadHooks(TFunction<void(Cell&)> onCreate, TFunction<void(Cell&)> onRelease)
+{
+	cellPool.OnCreate = MoveTemp(onCreate);
+	cellPool.OnRelease = MoveTemp(onRelease);
+}
+
+template<typename T>
+const TFunction<void(TCell<T>&)>& TGridManager<T>::GetCreateHook() const
+{
+	return cellPool.OnCreate;
+}
+
+template<typename T>
+const TFunction<void(TCell<T>&)>& TGridManager<T>::GetReleaseHook() const
+{
+	return cellPool.OnRelease;
+}
+
+template<typename T>
+void TGridManager<T>::SetLoader(TFunction<T(FIntPoint index)> load, TFunction<void(Cell&)> onLoaded)
+{
+	cellPool.SetLoader(nullptr);
+	loader.Reset();
+
+	if (!load)
+		return;
+
+	loader = MakeUnique<TCellLoader<T>>(cellPool, MoveTemp(load), MoveTemp(onLoaded));
+	cellPool.SetLoader(loader.Get());
+}
+
+template<typename T>
+int TGridManager<T>::PumpLoads(int maxCells)
+{
+	return loader ? loader->Pump(maxCells) : 0;
+}
+
+template<typename T>
+int TGridManager<T>::NumPendingLoads() const
+{
+	return loader ? loader->NumPending() : 0;
+}
+
+////////////////////////////////////////////////////////////////
+
+template<typename T>
+TCellPool<T>::TCellPool() {}
+
+template<typename T>
+TCellPool<T>::~TCellPool()
+{
+	// Cells could outlive the pool in user code, so make them unusable
+	for (auto& shard : shards)
+		for (auto& entry : shard.slabs)
+			for (auto& cc : entry.data->cells)
+			{
+				cc.Reset();
+				cc.pool = nullptr;
+			}
+}
+
+template<typename T>
+TCellPool<T>::ShardLock::ShardLock(const TCellPool& pool, Shard& shard)
+	: cs(pool.bThreadSafe ? &shard.lock : nullptr)
+{
+	if (cs)
+		cs->Lock();
+}
+
+template<typename T>
+TCellPool<T>::ShardLock::~ShardLock()
+{
+	if (cs)
+		cs->Unlock();
+}
+
+template<typename T>
+FIntPoint TCellPool<T>::GetRegion(FIntPoint index)
+{
+	// Arithmetic shift rounds negative indices down as well
+	return FIntPoint(index.X >> SlabShift, index.Y >> SlabShift);
+}
+
+template<typename T>
+int TCellPool<T>::GetSlot(FIntPoint index)
+{
+	return (index.Y & (SlabSide - 1)) * SlabSide + (index.X & (SlabSide - 1));
+}
+
+template<typename T>
+int TCellPool<T>::GetShard(FIntPoint region)
+{
+	return GetTypeHash(region) % NumShards;
+}
+
+template<typename T>
+TSharedPtr<TCell<T>, ESPMode::ThreadSafe> TCellPool<T>::Acquire(FIntPoint index, bool* bRevived)
+{
+	auto region = GetRegion(index);
+	auto& shard = shards[GetShard(region)];
+
+	CellPtr c;
+	bool bCached = false;
+	{
+		ShardLock lock(*this, shard);
+
+		auto& entry = shard.slabs[FindOrAddSlab(shard, region)];
+		c = entry.cells[GetSlot(index)];
+
+		if (c->IsValid())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("CellPool: cell is already alive."));
+			return c;
+		}
+
+		MakeAlive(entry, *c, index);
+		bCached = TakeCached(index, *c);
+	}
+
+	if (bRevived)
+		*bRevived = bCached;
+
+	// Payload came back as it was, only a never loaded one is requested again
+	if (!bCached && OnCreate)
+		OnCreate(*c);
+
+	if (loader && c->state == CellState::UNLOADED)
+		loader->Request(c);
+
+	return c;
+}
+
+template<typename T>
+void TCellPool<T>::AcquireRegion(FIntPoint region, TArray<CellPtr>& created, TArray<CellPtr>& promoted, TArray<CellPtr>& revived)
+{
+	auto& shard = shards[GetShard(region)];
+	int first = created.Num();
+	int firstRevived = revived.Num();
+
+	{
+		ShardLock lock(*this, shard);
+
+		auto& entry = shard.slabs[FindOrAddSlab(shard, region)];
+		auto origin = FIntPoint(region.X * SlabSide, region.Y * SlabSide);
+
+		// Slots go row by row, the same way they lie in memory
+		for (int slot = 0; slot < SlabSize; slot++)
+		{
+			auto& c = entry.cells[slot];
+
+			if (c->IsValid())
+			{
+				if (c->IsSpeculative())
+					promoted.Push(c);
+
+				c->nNumOwners++;
+				continue;
+			}
+
+			MakeAlive(entry, *c, origin + FIntPoint(slot & (SlabSide - 1), slot >> SlabShift));
+
+			if (TakeCached(c->GetIndex(), *c))
+				revived.Push(c);
+			else
+				created.Push(c);
+		}
+	}
+
+	for (int i = first; i < created.Num(); i++)
+	{
+		if (OnCreate)
+			OnCreate(*created[i]);
+
+		if (loader)
+			loader->Request(created[i]);
+	}
+
+	if (loader)
+		for (int i = firstRevived; i < revived.Num(); i++)
+			if (revived[i]->state == CellState::UNLOADED)
+				loader->Request(revived[i]);
+}
+
+template<typename T>
+template<typename F>
+int TCellPool<T>::ReleaseRegion(FIntPoint region, F&& onReleased)
+{
+	auto& shard = shards[GetShard(region)];
+
+	TArray<CellPtr> live;
+	{
+		ShardLock lock(*this, shard);
+
+		auto found = shard.regions.Find(region);
+		if (!found)
+			return 0;
+
+		auto& entry = shard.slabs[*found];
+		live.Reserve(entry.nNumLive);
+		for (auto& cc : entry.cells)
+			if (cc->IsValid())
+				live.Push(cc);
+	}
+
+	int num = 0;
+	for (auto& cc : live)
+	{
+		// Cell is still used by somebody else
+		if (cc->NumOwners()-- > 1)
+			continue;
+
+		Release(cc, onReleased);
+		num++;
+	}
+
+	return num;
+}
+
+template<typename T>
+int TCellPool<T>::FindOrAddSlab(Shard& shard, FIntPoint region)
+{
+	if (auto found = shard.regions.Find(region))
+		return *found;
+
+	int slabIdx = -1;
+
+	// Reuse an empty slab
+	if (shard.freeSlabs.Num())
+	{
+		slabIdx = shard.freeSlabs.Pop();
+		shard.slabs[slabIdx].region = region;
+	}
+	// Allocate a new one
+	else
+	{
+		SlabEntry entry;
+		entry.data = MakeShareable(new Slab());
+		entry.region = region;
+		for (auto& cc : entry.data->cells)
+			entry.cells.Push(CellPtr(entry.data, &cc));
+
+		slabIdx = shard.slabs.Add(entry);
+	}
+
+	shard.regions.Add(region, slabIdx);
+	return slabIdx;
+}
+
+template<typename T>
+void TCellPool<T>::MakeAlive(SlabEntry& entry, Cell& c, FIntPoint index)
+{
+	c.SetIndex(index);
+	c.pool = this;
+	c.nLevel = nLevel;
+	c.Data = T();
+	c.nNumOwners = 1;
+	c.nNumSpeculative = 0;
+	c.state = CellState::UNLOADED;
+	c.nGeneration = ++nNextGeneration;
+	c.bIsValid = true;
+	c.bIsReseted = false;
+
+	entry.nNumLive++;
+	nNumCreated++;
+}
+
+template<typename T>
+template<typename F>
+void TCellPool<T>::Release(CellPtr c, F&& onDeleted)
+{
+	if (!serenity::IsValid(c))
+		return;
+
+	auto index = c->GetIndex();
+	auto region = GetRegion(index);
+	auto& shard = shards[GetShard(region)];
+
+	{
+		ShardLock lock(*this, shard);
+
+		auto found = shard.regions.Find(region);
+		if (!found || shard.slabs[*found].cells[GetSlot(index)] != c)
+			return;
+	}
+
+	// A half loaded payload is worth nothing, its load is dropped below
+	CellState state = c->state;
+	bool bCache = nCacheMaxCells > 0 && state != CellState::LOADING;
+
+	if (loader)
+		loader->Cancel(*c);
+
+	// Anything still loading for this cell is stale from now on
+	c->nGeneration = ++nNextGeneration;
+	c->state = CellState::UNLOADED;
+
+	// Cached payload stays set up until it is evicted
+	if (!bCache && OnRelease)
+		OnRelease(*c);
+
+	T data = MoveTemp(c->Data);
+	c->Data = T();
+
+	TArray<TPair<FIntPoint, T>> evicted;
+	{
+		ShardLock lock(*this, shard);
+
+		// Neighbours are not stored, so nobody has to be unlinked
+		c->Reset();
+		nNumReleased++;
+
+		// Whole region is unloaded
+		int slabIdx = *shard.regions.Find(region);
+		auto& entry = shard.slabs[slabIdx];
+		if (--entry.nNumLive == 0)
+		{
+			shard.regions.Remove(entry.region);
+			shard.freeSlabs.Push(slabIdx);
+		}
+
+		// Cached under the shard lock, so the index can not come alive in between
+		if (bCache)
+			PutCached(index, MoveTemp(data), state, evicted);
+	}
+
+	if (!bCache)
+	{
+		onDeleted(MoveTemp(data));
+		return;
+	}
+
+	for (auto& e : evicted)
+		onDeleted(ReleaseEvicted(e.Key, MoveTemp(e.Value)));
+}
+
+template<typename T>
+const TSharedPtr<TCell<T>, ESPMode::ThreadSafe>& TCellPool<T>::Find(FIntPoint index) const
+{
+	static const CellPtr none = nullptr;
+
+	auto region = GetRegion(index);
+	auto& shard = shards[GetShard(region)];
+
+	ShardLock lock(*this, shard);
+
+	auto found = shard.regions.Find(region);
+	if (!found)
+		return none;
+
+	auto& c = shard.slabs[*found].cells[GetSlot(index)];
+	return c->IsValid() ? c : none;
+}
+
+template<typename T>
+const TSharedPtr<TCell<T>, ESPMode::ThreadSafe>* TCellPool<T>::FindSlabCells(FIntPoint region) const
+{
+	auto& shard = shards[GetShard(region)];
+
+	ShardLock lock(*this, shard);
+
+	auto found = shard.regions.Find(region);
+	return found ? shard.slabs[*found].cells.GetData() : nullptr;
+}
+
+template<typename T>
+template<typename F>
+void TCellPool<T>::ForEachInRect(FIntPoint min, FIntPoint max, F&& f) const
+{
+	if (min.X > max.X || min.Y > max.Y)
+		return;
+
+	FIntPoint lo = GetRegion(min);
+	FIntPoint hi = GetRegion(max);
+
+	for (int ry = lo.Y; ry <= hi.Y; ry++)
+		for (int rx = lo.X; rx <= hi.X; rx++)
+		{
+			const CellPtr* cells = FindSlabCells(FIntPoint(rx, ry));
+			if (!cells)
+				continue;
+
+			// Part of the rectangle inside the slab, in slab coords
+			FIntPoint origin(rx * SlabSide, ry * SlabSide);
+			int x0 = FMath::Max(min.X - origin.X, 0);
+			int x1 = FMath::Min(max.X - origin.X, SlabSide - 1);
+			int y0 = FMath::Max(min.Y - origin.Y, 0);
+			int y1 = FMath::Min(max.Y - origin.Y, SlabSide - 1);
+
+			// Slab is not freed for good, cells released by f read as dead
+			for (int y = y0; y <= y1; y++)
+				for (int x = x0; x <= x1; x++)
+				{
+					const CellPtr& c = cells[y * SlabSide + x];
+					if (c->IsValid())
+						f(c);
+				}
+		}
+}
+
+template<typename T>
+template<typename F>
+void TCellPool<T>::ForEachLive(F&& f) const
+{
+	for (auto& shard : shards)
+	{
+		for (int i = 0; i < shard.slabs.Num(); i++)
+		{
+			const CellPtr* cells = nullptr;
+			{
+				ShardLock lock(*this, shard);
+				if (shard.slabs[i].nNumLive > 0)
+					cells = shard.slabs[i].cells.GetData();
+			}
+
+			if (!cells)
+				continue;
+
+			for (int slot = 0; slot < SlabSize; slot++)
+				if (cells[slot]->IsValid())
+					f(cells[slot]);
+		}
+	}
+}
+
+template<typename T>
+int TCellPool<T>::NumSlabs() const
+{
+	int num = 0;
+	for (auto& shard : shards)
+		num += shard.slabs.Num();
+
+	return num;
+}
+
+template<typename T>
+int TCellPool<T>::NumFreeSlabs() const
+{
+	int num = 0;
+	for (auto& shard : shards)
+		num += shard.freeSlabs.Num();
+
+	return num;
+}
+
+template<typename T>
+CellStats TCellPool<T>::GetStats() const
+{
+	CellStats stats;
+	stats.numCreated = nNumCreated;
+	stats.numReleased = nNumReleased;
+	stats.numLive = stats.numCreated - stats.numReleased;
+	stats.numCached = NumCached();
+	stats.numSlabs = NumSlabs();
+	stats.numFreeSlabs = NumFreeSlabs();
+
+	return stats;
+}
+
+template<typename T>
+void TCellPool<T>::SetThreadSafe(bool bEnable)
+{
+	bThreadSafe = bEnable;
+}
+
+template<typename T>
+void TCellPool<T>::SetLevel(int level)
+{
+	nLevel = (uint8)level;
+}
+
+template<typename T>
+void TCellPool<T>::SetLoader(TCellLoader<T>* cellLoader)
+{
+	loader = cellLoader;
+}
+
+template<typename T>
+void TCellPool<T>::SetCache(int maxCells, int64 maxBytes, TFunction<int64(const T&)> payloadSize)
+{
+	FScopeLock lock(&cacheLock);
+
+	nCacheMaxCells = FMath::Max(maxCells, 0);
+	nCacheMaxBytes = payloadSize ? FMath::Max(maxBytes, int64(0)) : 0;
+	cacheSizeOf = MoveTemp(payloadSize);
+}
+
+template<typename T>
+template<typename F>
+void TCellPool<T>::EmptyCache(F&& onDeleted)
+{
+	TArray<TPair<FIntPoint, T>> evicted;
+	{
+		FScopeLock lock(&cacheLock);
+
+		for (int idx = nCacheHead; idx >= 0; idx = cache[idx].next)
+			evicted.Push({ cache[idx].index, MoveTemp(cache[idx].data) });
+
+		cache.Reset();
+		freeCache.Reset();
+		cacheIndex.Reset();
+		nNumCached = 0;
+		nCacheHead = nCacheTail = -1;
+		nCacheBytes = 0;
+	}
+
+	for (auto& e : evicted)
+		onDeleted(ReleaseEvicted(e.Key, MoveTemp(e.Value)));
+}
+
+template<typename T>
+int TCellPool<T>::NumCached() const
+{
+	return nNumCached;
+}
+
+template<typename T>
+bool TCellPool<T>::TakeCached(FIntPoint index, Cell& c)
+{
+	if (nNumCached == 0)
+		return false;
+
+	FScopeLock lock(&cacheLock);
+
+	auto found = cacheIndex.Find(index);
+	if (!found)
+		return false;
+
+	int idx = *found;
+	cacheIndex.Remove(index);
+	nNumCached--;
+	UnlinkCached(idx);
+
+	auto& e = cache[idx];
+	c.Data = MoveTemp(e.data);
+	c.state = e.state;
+	nCacheBytes -= e.nBytes;
+
+	e.data = T();
+	freeCache.Push(idx);
+	return true;
+}
+
+template<typename T>
+void TCellPool<T>::PutCached(FIntPoint index, T&& data, CellState state, TArray<TPair<FIntPoint, T>>& evicted)
+{
+	FScopeLock lock(&cacheLock);
+
+	int idx = freeCache.Num() ? freeCache.Pop() : cache.Add(CacheEntry());
+
+	auto& e = cache[idx];
+	e.index = index;
+	e.nBytes = nCacheMaxBytes > 0 ? cacheSizeOf(data) : 0;
+	e.data = MoveTemp(data);
+	e.state = state;
+
+	// Most recently released goes first
+	e.prev = -1;
+	e.next = nCacheHead;
+	if (nCacheHead >= 0)
+		cache[nCacheHead].prev = idx;
+	nCacheHead = idx;
+	if (nCacheTail < 0)
+		nCacheTail = idx;
+
+	cacheIndex.Add(index, idx);
+	nNumCached++;
+	nCacheBytes += e.nBytes;
+
+	// Evict from the tail, a payload bigger than the whole budget does not stay either
+	while (nCacheTail >= 0 && (cacheIndex.Num() > nCacheMaxCells || (nCacheMaxBytes > 0 && nCacheBytes > nCacheMaxBytes)))
+	{
+		int last = nCacheTail;
+		auto& old = cache[last];
+
+		UnlinkCached(last);
+		cacheIndex.Remove(old.index);
+		nNumCached--;
+		nCacheBytes -= old.nBytes;
+
+		evicted.Push({ old.index, MoveTemp(old.data) });
+		old.data = T();
+		freeCache.Push(last);
+	}
+}
+
+template<typename T>
+void TCellPool<T>::UnlinkCached(int idx)
+{
+	auto& e = cache[idx];
+
+	if (e.prev >= 0)
+		cache[e.prev].next = e.next;
+	else
+		nCacheHead = e.next;
+
+	if (e.next >= 0)
+		cache[e.next].prev = e.prev;
+	else
+		nCacheTail = e.prev;
+
+	e.prev = e.next = -1;
+}
+
+template<typename T>
+T TCellPool<T>::ReleaseEvicted(FIntPoint index, T&& data)
+{
+	if (!OnRelease)
+		return MoveTemp(data);
+
+	// Release hook sees the payload as if its cell was still there
+	Cell c;
+	c.SetIndex(index);
+	c.Data = MoveTemp(data);
+	OnRelease(c);
+
+	return MoveTemp(c.Data);
+}
+
+////////////////////////////////////////////////////////////////
+
+template<typename T>
+TCellLoader<T>::TCellLoader(const TCellPool<T>& pool, TFunction<T(FIntPoint)> load, TFunction<void(Cell&)> onLoaded)
+	: pool(pool), load(MoveTemp(load)), onLoaded(MoveTemp(onLoaded)) {}
+
+template<typename T>
+TCellLoader<T>::~TCellLoader()
+{
+	// Queued tasks still run, but return right away
+	bStopped = true;
+	while (nInFlight > 0)
+		FPlatformProcess::Sleep(0.0f);
+}
+
+template<typename T>
+void TCellLoader<T>::Request(const CellPtr& c)
+{
+	c->state = CellState::LOADING;
+	nPending++;
+	nInFlight++;
+
+	// The task never holds the cell, Pump looks it up again by index and generation
+	uint64 generation = c->GetGeneration();
+	FIntPoint index = c->GetIndex();
+
+	Token token = MakeShared<std::atomic<bool>, ESPMode::ThreadSafe>(false);
+	{
+		FScopeLock lock(&tokensLock);
+		tokens.Add(index, token);
+	}
+
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [this, index, generation, token]()
+	{
+		// Cancelled before a worker got to it, nothing to load
+		if (!bStopped && !*token)
+		{
+			Result r;
+			r.index = index;
+			r.generation = generation;
+			r.token = token;
+			r.data = load(index);
+			done.Enqueue(MoveTemp(r));
+		}
+
+		nInFlight--;
+	});
+}
+
+template<typename T>
+void TCellLoader<T>::Cancel(Cell& c)
+{
+	if (c.state != CellState::LOADING)
+		return;
+
+	nPending--;
+
+	FScopeLock lock(&tokensLock);
+
+	if (auto token = tokens.Find(c.GetIndex()))
+	{
+		**token = true;
+		tokens.Remove(c.GetIndex());
+	}
+}
+
+template<typename T>
+int TCellLoader<T>::Pump(int maxCells)
+{
+	int num = 0;
+
+	Result r;
+	while ((maxCells < 0 || num < maxCells) && done.Dequeue(r))
+	{
+		// Cancelled while the worker was loading
+		if (*r.token)
+			continue;
+
+		{
+			FScopeLock lock(&tokensLock);
+			tokens.Remove(r.index);
+		}
+
+		// Released while loading, possibly alive again as another cell
+		const CellPtr& c = pool.Find(r.index);
+		if (!c || c->GetGeneration() != r.generation || c->state != CellState::LOADING)
+			continue;
+
+		c->Data = MoveTemp(r.data);
+		c->state = CellState::READY;
+		nPending--;
+		num++;
+
+		if (onLoaded)
+			onLoaded(*c);
+	}
+
+	return num;
+}
+
+template<typename T>
+int TCellLoader<T>::NumPending() const
+{
+	return nPending;
+}
+
+template<typename T>
+TGridManager<T>::~TGridManager() 
+{
+	/*for (auto grid : rootGrids)
+		if (grid) grid.Reset();*/
+}
+}
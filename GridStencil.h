@@ -0,0 +1,115 @@
+#pragma once
+#include <type_traits>
+#include "DynamicGrid.h"
+
+// x64 always has SSE2, other targets run the plain loops
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SERENITY_STENCIL_SSE 1
+#else
+#define SERENITY_STENCIL_SSE 0
+#endif
+
+namespace serenity
+{
+	// Runs 3x3 neighbourhood kernels over values of type V taken from the live cells of a manager.
+	// Values are copied into dense tiles, one per pool slab with a one cell apron around it, so a
+	// kernel reads the 8 neighbours next to the cell instead of looking them up. Tiles are double
+	// buffered, a pass reads one buffer and writes the other. A cell shared by several grids is
+	// in one tile only
+	template<typename T, typename V>
+	class TGridStencil
+	{
+	public:
+		typedef TCell<T> Cell;
+		typedef TSharedPtr<Cell, ESPMode::ThreadSafe> CellPtr;
+		typedef TGridManager<T> GridManager;
+
+		static const int TileSide = TCellPool<T>::SlabSide;
+		static const int Stride = TileSide + 2;
+		static const int TileSize = Stride * Stride;
+
+		// Cell and its neighbours as a kernel sees them, (0, 0) is the cell
+		class Window
+		{
+		public:
+			explicit Window(const V* center) : p(center) {}
+
+			const V& operator()(int dx, int dy) const { return p[dy * Stride + dx]; }
+
+		private:
+			const V* p;
+		};
+
+		// Takes read(const Cell&) of every live cell, buffers of the last gather are reused
+		template<typename F>
+		void Gather(const GridManager& manager, F&& read);
+
+		// Hands the value of every gathered cell that is still alive to write(Cell&, const V&)
+		template<typename F>
+		void Scatter(const GridManager& manager, F&& write) const;
+
+		// One pass of kernel(const Window&) -> V over every gathered cell. Rows of a tile are
+		// plain loops, so a kernel without branches is vectorised by the compiler
+		template<typename F>
+		void Apply(F&& kernel);
+
+		// out = sum of weights[(dy + 1) * 3 + dx + 1] * value(dx, dy). Uses SSE for float
+		void Convolve(const V (&weights)[9]);
+
+		// out = max(value, largest neighbour - decay), influence spreads a cell a pass.
+		// Uses SSE for float and int32
+		void Spread(V decay);
+
+		// Value of cells that were not gathered, neighbours out of the loaded area read it
+		void SetOutside(V value);
+		V GetOutside() const;
+
+		// Current value of a gathered cell, the outside value at any other index
+		V Get(FIntPoint index) const;
+		// Value a gathered cell starts the next pass with, false if the cell was not gathered
+		bool Set(FIntPoint index, V value);
+
+		int NumCells() const;
+		int NumTiles() const;
+
+	private:
+		struct Tile
+		{
+			FIntPoint region;
+
+			// Tiles around, row by row from (-1, -1) and without this one, -1 if there is none
+			int neighbours[8];
+
+			int nNumLive = 0;
+			uint8 live[TileSide * TileSide];
+		};
+
+		int AddTile(FIntPoint region);
+		// Offset of the cell in the buffers, apron included
+		static int GetOffset(int tile, FIntPoint index);
+		int FindTile(FIntPoint region) const;
+
+		// Copies edges of neighbour tiles into the aprons of the front buffer
+		void FillAprons();
+
+		// Calls row(in, out) for each row of every tile, in points at the first cell of the row
+		// in the front buffer and out at the same cell in the back one. Then swaps the buffers
+		template<typename F>
+		void ForEachRow(F&& row);
+
+		TArray<Tile> tiles;
+		TMap<FIntPoint, int> tileIndex;
+
+		TArray<V> buffers[2];
+		int nFront = 0;
+		int nNumCells = 0;
+
+		V outside = V();
+	};
+
+	// Untyped flavour, float values over cells with pointer payloads
+	typedef TGridStencil<void*, float> GridStencil;
+}
+
+#include "GridStencil.inl"
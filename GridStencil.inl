@@ -0,0 +1,339 @@
+#pragma once
+
+namespace serenity
+{
+template<typename T, typename V>
+template<typename F>
+void TGridStencil<T, V>::Gather(const GridManager& manager, F&& read)
+{
+	tiles.Reset();
+	tileIndex.Reset();
+	buffers[0].Reset();
+	buffers[1].Reset();
+	nFront = 0;
+	nNumCells = 0;
+
+	// Cells come slab by slab, so a tile is looked up once per slab
+	int tile = -1;
+	FIntPoint region;
+
+	manager.ForEachCell([&](const CellPtr& c)
+		{
+			FIntPoint index = c->GetIndex();
+
+			if (tile < 0 || TCellPool<T>::GetRegion(index) != region)
+			{
+				region = TCellPool<T>::GetRegion(index);
+
+				int found = FindTile(region);
+				tile = found >= 0 ? found : AddTile(region);
+			}
+
+			int slot = (index.Y & (TileSide - 1)) * TileSide + (index.X & (TileSide - 1));
+			tiles[tile].live[slot] = 1;
+			tiles[tile].nNumLive++;
+
+			buffers[0][GetOffset(tile, index)] = read(*c);
+			nNumCells++;
+		});
+
+	for (auto& t : tiles)
+	{
+		int n = 0;
+		for (int dy = -1; dy <= 1; dy++)
+			for (int dx = -1; dx <= 1; dx++)
+				if (dx || dy)
+					t.neighbours[n++] = FindTile(t.region + FIntPoint(dx, dy));
+	}
+
+	buffers[1] = buffers[0];
+}
+
+template<typename T, typename V>
+template<typename F>
+void TGridStencil<T, V>::Scatter(const GridManager& manager, F&& write) const
+{
+	int tile = -1;
+	FIntPoint region;
+
+	manager.ForEachCell([&](const CellPtr& c)
+		{
+			FIntPoint index = c->GetIndex();
+
+			if (tile < 0 || TCellPool<T>::GetRegion(index) != region)
+			{
+				region = TCellPool<T>::GetRegion(index);
+				tile = FindTile(region);
+			}
+
+			// Cells created after the gather have no value
+			int slot = (index.Y & (TileSide - 1)) * TileSide + (index.X & (TileSide - 1));
+			if (tile >= 0 && tiles[tile].live[slot])
+				write(*c, buffers[nFront][GetOffset(tile, index)]);
+		});
+}
+
+template<typename T, typename V>
+template<typename F>
+void TGridStencil<T, V>::Apply(F&& kernel)
+{
+	ForEachRow([&](const V* in, V* out)
+		{
+			for (int x = 0; x < TileSide; x++)
+				out[x] = kernel(Window(in + x));
+		});
+}
+
+template<typename T, typename V>
+void TGridStencil<T, V>::Convolve(const V (&weights)[9])
+{
+#if SERENITY_STENCIL_SSE
+	if constexpr (std::is_same<V, float>::value)
+	{
+		__m128 w[9];
+		for (int i = 0; i < 9; i++)
+			w[i] = _mm_set1_ps(weights[i]);
+
+		// Four cells at a time, terms are added in the same order as below
+		ForEachRow([&](const float* in, float* out)
+			{
+				for (int x = 0; x < TileSide; x += 4)
+				{
+					__m128 acc = _mm_setzero_ps();
+					for (int dy = -1; dy <= 1; dy++)
+						for (int dx = -1; dx <= 1; dx++)
+							acc = _mm_add_ps(acc, _mm_mul_ps(w[(dy + 1) * 3 + dx + 1], _mm_loadu_ps(in + dy * Stride + dx + x)));
+
+					_mm_storeu_ps(out + x, acc);
+				}
+			});
+
+		return;
+	}
+#endif
+
+	Apply([&](const Window& n)
+		{
+			V acc = V();
+			for (int dy = -1; dy <= 1; dy++)
+				for (int dx = -1; dx <= 1; dx++)
+					acc = acc + weights[(dy + 1) * 3 + dx + 1] * n(dx, dy);
+
+			return acc;
+		});
+}
+
+template<typename T, typename V>
+void TGridStencil<T, V>::Spread(V decay)
+{
+#if SERENITY_STENCIL_SSE
+	if constexpr (std::is_same<V, float>::value)
+	{
+		__m128 d = _mm_set1_ps(decay);
+
+		ForEachRow([&](const float* in, float* out)
+			{
+				for (int x = 0; x < TileSide; x += 4)
+				{
+					const float* c = in + x;
+					__m128 best = _mm_max_ps(_mm_loadu_ps(c - Stride - 1), _mm_loadu_ps(c - Stride));
+					best = _mm_max_ps(best, _mm_loadu_ps(c - Stride + 1));
+					best = _mm_max_ps(best, _mm_loadu_ps(c - 1));
+					best = _mm_max_ps(best, _mm_loadu_ps(c + 1));
+					best = _mm_max_ps(best, _mm_loadu_ps(c + Stride - 1));
+					best = _mm_max_ps(best, _mm_loadu_ps(c + Stride));
+					best = _mm_max_ps(best, _mm_loadu_ps(c + Stride + 1));
+
+					_mm_storeu_ps(out + x, _mm_max_ps(_mm_loadu_ps(c), _mm_sub_ps(best, d)));
+				}
+			});
+
+		return;
+	}
+	else if constexpr (std::is_same<V, int32>::value)
+	{
+		__m128i d = _mm_set1_epi32(decay);
+
+		// SSE2 has no 32-bit max, it is a compare and a select
+		auto max = [](__m128i a, __m128i b)
+		{
+			__m128i gt = _mm_cmpgt_epi32(a, b);
+			return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+		};
+		auto load = [](const int32* p)
+		{
+			return _mm_loadu_si128((const __m128i*)p);
+		};
+
+		ForEachRow([&](const int32* in, int32* out)
+			{
+				for (int x = 0; x < TileSide; x += 4)
+				{
+					const int32* c = in + x;
+					__m128i best = max(load(c - Stride - 1), load(c - Stride));
+					best = max(best, load(c - Stride + 1));
+					best = max(best, load(c - 1));
+					best = max(best, load(c + 1));
+					best = max(best, load(c + Stride - 1));
+					best = max(best, load(c + Stride));
+					best = max(best, load(c + Stride + 1));
+
+					_mm_storeu_si128((__m128i*)(out + x), max(load(c), _mm_sub_epi32(best, d)));
+				}
+			});
+
+		return;
+	}
+#endif
+
+	Apply([&](const Window& n)
+		{
+			V best = n(-1, -1);
+			for (int dy = -1; dy <= 1; dy++)
+				for (int dx = -1; dx <= 1; dx++)
+					if (dx || dy)
+						best = FMath::Max(best, n(dx, dy));
+
+			return FMath::Max(n(0, 0), best - decay);
+		});
+}
+
+template<typename T, typename V>
+void TGridStencil<T, V>::SetOutside(V value)
+{
+	outside = value;
+}
+
+template<typename T, typename V>
+V TGridStencil<T, V>::GetOutside() const
+{
+	return outside;
+}
+
+template<typename T, typename V>
+V TGridStencil<T, V>::Get(FIntPoint index) const
+{
+	int tile = FindTile(TCellPool<T>::GetRegion(index));
+	if (tile < 0)
+		return outside;
+
+	return buffers[nFront][GetOffset(tile, index)];
+}
+
+template<typename T, typename V>
+bool TGridStencil<T, V>::Set(FIntPoint index, V value)
+{
+	int tile = FindTile(TCellPool<T>::GetRegion(index));
+	int slot = (index.Y & (TileSide - 1)) * TileSide + (index.X & (TileSide - 1));
+	if (tile < 0 || !tiles[tile].live[slot])
+		return false;
+
+	buffers[nFront][GetOffset(tile, index)] = value;
+	return true;
+}
+
+template<typename T, typename V>
+int TGridStencil<T, V>::NumCells() const
+{
+	return nNumCells;
+}
+
+template<typename T, typename V>
+int TGridStencil<T, V>::NumTiles() const
+{
+	return tiles.Num();
+}
+
+template<typename T, typename V>
+int TGridStencil<T, V>::AddTile(FIntPoint region)
+{
+	Tile t;
+	t.region = region;
+	FMemory::Memzero(t.live, sizeof(t.live));
+
+	int tile = tiles.Add(t);
+	tileIndex.Add(region, tile);
+
+	// Cells that are not alive read as outside
+	buffers[0].SetNum((tile + 1) * TileSize);
+	for (int i = tile * TileSize; i < (tile + 1) * TileSize; i++)
+		buffers[0][i] = outside;
+
+	return tile;
+}
+
+template<typename T, typename V>
+int TGridStencil<T, V>::GetOffset(int tile, FIntPoint index)
+{
+	int x = index.X & (TileSide - 1);
+	int y = index.Y & (TileSide - 1);
+
+	return tile * TileSize + (y + 1) * Stride + x + 1;
+}
+
+template<typename T, typename V>
+int TGridStencil<T, V>::FindTile(FIntPoint region) const
+{
+	const int* found = tileIndex.Find(region);
+	return found ? *found : -1;
+}
+
+template<typename T, typename V>
+void TGridStencil<T, V>::FillAprons()
+{
+	V* data = buffers[nFront].GetData();
+	const int last = TileSide;
+
+	for (int t = 0; t < tiles.Num(); t++)
+	{
+		V* dst = data + t * TileSize;
+		const int* nb = tiles[t].neighbours;
+
+		// Source cell of a neighbour tile, or the outside value when there is none
+		auto at = [&](int n, int x, int y) -> V
+		{
+			return nb[n] >= 0 ? data[nb[n] * TileSize + y * Stride + x] : outside;
+		};
+
+		dst[0] = at(0, last, last);
+		dst[last + 1] = at(2, 1, last);
+		dst[(last + 1) * Stride] = at(5, last, 1);
+		dst[(last + 1) * Stride + last + 1] = at(7, 1, 1);
+
+		for (int i = 1; i <= last; i++)
+		{
+			dst[i] = at(1, i, last);
+			dst[(last + 1) * Stride + i] = at(6, i, 1);
+			dst[i * Stride] = at(3, last, i);
+			dst[i * Stride + last + 1] = at(4, 1, i);
+		}
+	}
+}
+
+template<typename T, typename V>
+template<typename F>
+void TGridStencil<T, V>::ForEachRow(F&& row)
+{
+	FillAprons();
+
+	const V* in = buffers[nFront].GetData();
+	V* out = buffers[1 - nFront].GetData();
+
+	for (int t = 0; t < tiles.Num(); t++)
+	{
+		int base = t * TileSize + Stride + 1;
+		for (int y = 0; y < TileSide; y++)
+			row(in + base + y * Stride, out + base + y * Stride);
+
+		// Holes of the slab stay outside
+		if (tiles[t].nNumLive == TileSide * TileSide)
+			continue;
+
+		for (int slot = 0; slot < TileSide * TileSide; slot++)
+			if (!tiles[t].live[slot])
+				out[base + (slot / TileSide) * Stride + slot % TileSide] = outside;
+	}
+
+	nFront = 1 - nFront;
+}
+}
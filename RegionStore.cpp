@@ -0,0 +1,208 @@
+#include "RegionStore.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <windows.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+#elif PLATFORM_LINUX || PLATFORM_MAC
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace serenity;
+
+MappedRegionFile::~MappedRegionFile()
+{
+	Close();
+}
+
+#if PLATFORM_WINDOWS
+
+bool MappedRegionFile::Open(const FString& path, size_t fileSize)
+{
+	Close();
+
+	HANDLE file = CreateFileA(TCHAR_TO_UTF8(*path), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+		OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	fileHandle = file;
+
+	LARGE_INTEGER st;
+	if (!GetFileSizeEx(file, &st))
+	{
+		Close();
+		return false;
+	}
+
+	bIsNew = st.QuadPart == 0;
+
+	// Mapping grows a shorter file, the grown part reads as zero bytes
+	uint64 mappingSize = fileSize;
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, DWORD(mappingSize >> 32), DWORD(mappingSize & 0xffffffff), nullptr);
+	if (!mapping)
+	{
+		Close();
+		return false;
+	}
+
+	mappingHandle = mapping;
+
+	void* mapped = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, fileSize);
+	if (!mapped)
+	{
+		Close();
+		return false;
+	}
+
+	data = static_cast<uint8*>(mapped);
+	size = fileSize;
+
+	return true;
+}
+
+void MappedRegionFile::Flush()
+{
+	if (!data)
+		return;
+
+	// Dirty pages go to the file cache first, then to disk
+	FlushViewOfFile(data, size);
+	FlushFileBuffers((HANDLE)fileHandle);
+}
+
+void MappedRegionFile::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+
+	if (mappingHandle)
+		CloseHandle((HANDLE)mappingHandle);
+
+	if (fileHandle)
+		CloseHandle((HANDLE)fileHandle);
+
+	data = nullptr;
+	size = 0;
+	fileHandle = nullptr;
+	mappingHandle = nullptr;
+}
+
+bool MappedRegionFile::MakeDirectory(const FString& path)
+{
+	return CreateDirectoryA(TCHAR_TO_UTF8(*path), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+#elif PLATFORM_LINUX || PLATFORM_MAC
+
+bool MappedRegionFile::Open(const FString& path, size_t fileSize)
+{
+	Close();
+
+	fd = open(TCHAR_TO_UTF8(*path), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		Close();
+		return false;
+	}
+
+	bIsNew = st.st_size == 0;
+
+	// Grown part of the file reads as zero bytes
+	if ((size_t)st.st_size < fileSize && ftruncate(fd, fileSize) != 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* mapped = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	data = static_cast<uint8*>(mapped);
+	size = fileSize;
+
+	return true;
+}
+
+void MappedRegionFile::Flush()
+{
+	if (data)
+		msync(data, size, MS_SYNC);
+}
+
+void MappedRegionFile::Close()
+{
+	if (data)
+		munmap(data, size);
+
+	if (fd >= 0)
+		close(fd);
+
+	data = nullptr;
+	size = 0;
+	fd = -1;
+}
+
+bool MappedRegionFile::MakeDirectory(const FString& path)
+{
+	return mkdir(TCHAR_TO_UTF8(*path), 0755) == 0 || errno == EEXIST;
+}
+
+#else
+
+// No file mapping here, the store logs every region as unusable
+bool MappedRegionFile::Open(const FString& /*path*/, size_t /*fileSize*/)
+{
+	return false;
+}
+
+void MappedRegionFile::Flush()
+{
+}
+
+void MappedRegionFile::Close()
+{
+}
+
+bool MappedRegionFile::MakeDirectory(const FString& /*path*/)
+{
+	return false;
+}
+
+#endif
+
+uint8* MappedRegionFile::GetData() const
+{
+	return data;
+}
+
+bool MappedRegionFile::IsOpen() const
+{
+	return data != nullptr;
+}
+
+bool MappedRegionFile::IsNew() const
+{
+	return bIsNew;
+}
+
+namespace serenity
+{
+	// Compiles the store and every payload flavour Attach accepts
+	template class TRegionStore<uint32>;
+	template void TRegionStore<uint32>::Attach<uint32>(TGridManager<uint32>& manager);
+	template void TRegionStore<uint32>::Attach<uint32*>(TGridManager<uint32*>& manager);
+	template void TRegionStore<uint32>::Attach<void*>(TGridManager<void*>& manager);
+}
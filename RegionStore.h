@@ -0,0 +1,118 @@
+#pragma once
+#include <type_traits>
+#include "DynamicGrid.h"
+
+namespace serenity
+{
+	// Region file mapped into memory for reading and writing.
+	// Mapping works on Windows, Linux and Mac, elsewhere Open fails
+	class MappedRegionFile
+	{
+	public:
+		~MappedRegionFile();
+
+		// Opens or creates the file, it is grown to fileSize with zero bytes if shorter
+		bool Open(const FString& path, size_t fileSize);
+
+		// Writes changed pages back to disk
+		void Flush();
+		void Close();
+
+		uint8* GetData() const;
+		bool IsOpen() const;
+
+		// File did not exist or was empty before Open
+		bool IsNew() const;
+
+		static bool MakeDirectory(const FString& path);
+
+	private:
+#if PLATFORM_WINDOWS
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+#else
+		int fd = -1;
+#endif
+		uint8* data = nullptr;
+		size_t size = 0;
+		bool bIsNew = false;
+	};
+
+	// Cell records stored on disk, one file of RegionSide x RegionSide records per region.
+	// Records are used right in the mapped pages, so R must be plain bytes
+	template<typename R>
+	class TRegionStore
+	{
+		static_assert(std::is_trivially_copyable<R>::value, "Records are written to disk as raw bytes");
+
+	public:
+		static const int RegionShift = 5;
+		static const int RegionSide = 1 << RegionShift;
+		static const int RegionSize = RegionSide * RegionSide;
+
+		static const uint32 Magic = 0x44524753; // "SGRD"
+		static const uint32 Version = 1;
+
+		explicit TRegionStore(const FString& directory);
+
+		// Writes everything back. Records handed out before are not valid anymore
+		~TRegionStore();
+
+		// Record of the cell in the mapped file, the region is mapped on first use.
+		// Stays valid until the matching Unpin, null if the file could not be used
+		R* Pin(FIntPoint index);
+
+		// Record of a pinned cell
+		R* Find(FIntPoint index) const;
+
+		// Region is written back and unmapped by a later Flush once nothing pins it
+		void Unpin(FIntPoint index, bool bDirty);
+
+		// Writes dirty regions back and unmaps unused ones in one batch, call it once in a while
+		void Flush();
+
+		int NumMapped() const;
+
+		// Sets payload hooks of the manager. A payload of type R gets a copy of the record
+		// and is copied back on release, a pointer payload points straight at the record.
+		// Hooks set before keep running, they see the record in the payload
+		template<typename T>
+		void Attach(TGridManager<T>& manager);
+
+	protected:
+		struct Header
+		{
+			uint32 magic;
+			uint32 version;
+			uint32 recordSize;
+			uint32 side;
+		};
+
+		// Records start at the next cache line after the header
+		static const size_t DataOffset = 64;
+		static const size_t FileSize = DataOffset + sizeof(R) * RegionSize;
+
+		struct Region
+		{
+			MappedRegionFile file;
+			int nNumPins = 0;
+			bool bDirty = false;
+		};
+
+		static FIntPoint GetRegion(FIntPoint index);
+		static int GetSlot(FIntPoint index);
+
+		// Maps the file of the region, checks the header of an existing one
+		bool MapRegion(FIntPoint key, Region& region);
+
+		R* GetRecord(const Region& region, FIntPoint index) const;
+
+		FString directory;
+
+		// Regions are kept by pointer, so mapped files do not move when the map grows
+		TMap<FIntPoint, TSharedPtr<Region>> regions;
+		mutable FCriticalSection lock;
+	};
+}
+
+#include "RegionStore.inl"
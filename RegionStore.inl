@@ -0,0 +1,211 @@
+#pragma once
+
+namespace serenity
+{
+template<typename R>
+TRegionStore<R>::TRegionStore(const FString& directory) : directory(directory)
+{
+	if (!MappedRegionFile::MakeDirectory(directory))
+		UE_LOG(LogTemp, Error, TEXT("RegionStore: can not create directory %s."), *directory);
+}
+
+template<typename R>
+TRegionStore<R>::~TRegionStore()
+{
+	FScopeLock scope(&lock);
+
+	for (auto& pair : regions)
+		pair.Value->file.Flush();
+
+	regions.Empty();
+}
+
+template<typename R>
+FIntPoint TRegionStore<R>::GetRegion(FIntPoint index)
+{
+	// Arithmetic shift rounds negative indices down as well
+	return FIntPoint(index.X >> RegionShift, index.Y >> RegionShift);
+}
+
+template<typename R>
+int TRegionStore<R>::GetSlot(FIntPoint index)
+{
+	return (index.Y & (RegionSide - 1)) * RegionSide + (index.X & (RegionSide - 1));
+}
+
+template<typename R>
+bool TRegionStore<R>::MapRegion(FIntPoint key, Region& region)
+{
+	auto path = FString::Printf(TEXT("%s/%d.%d.region"), *directory, key.X, key.Y);
+
+	if (!region.file.Open(path, FileSize))
+	{
+		UE_LOG(LogTemp, Error, TEXT("RegionStore: can not map %s."), *path);
+		return false;
+	}
+
+	auto header = reinterpret_cast<Header*>(region.file.GetData());
+
+	if (region.file.IsNew())
+	{
+		header->magic = Magic;
+		header->version = Version;
+		header->recordSize = sizeof(R);
+		header->side = RegionSide;
+		region.bDirty = true;
+	}
+	// File of another format, leave it as it is
+	else if (header->magic != Magic || header->version != Version || header->recordSize != sizeof(R) || header->side != RegionSide)
+	{
+		UE_LOG(LogTemp, Error, TEXT("RegionStore: %s has a different format."), *path);
+		region.file.Close();
+		return false;
+	}
+
+	return true;
+}
+
+template<typename R>
+R* TRegionStore<R>::GetRecord(const Region& region, FIntPoint index) const
+{
+	if (!region.file.IsOpen())
+		return nullptr;
+
+	return reinterpret_cast<R*>(region.file.GetData() + DataOffset) + GetSlot(index);
+}
+
+template<typename R>
+R* TRegionStore<R>::Pin(FIntPoint index)
+{
+	auto key = GetRegion(index);
+
+	FScopeLock scope(&lock);
+
+	auto found = regions.Find(key);
+	TSharedPtr<Region> region = found ? *found : nullptr;
+
+	if (!region.IsValid())
+	{
+		region = MakeShared<Region>();
+		regions.Add(key, region);
+
+		MapRegion(key, *region);
+	}
+
+	// Counted even if the file is unusable, so Unpin always matches
+	region->nNumPins++;
+
+	return GetRecord(*region, index);
+}
+
+template<typename R>
+R* TRegionStore<R>::Find(FIntPoint index) const
+{
+	FScopeLock scope(&lock);
+
+	auto found = regions.Find(GetRegion(index));
+	return found ? GetRecord(**found, index) : nullptr;
+}
+
+template<typename R>
+void TRegionStore<R>::Unpin(FIntPoint index, bool bDirty)
+{
+	FScopeLock scope(&lock);
+
+	auto found = regions.Find(GetRegion(index));
+	if (!found || (*found)->nNumPins <= 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("RegionStore: unpinned region is not pinned."));
+		return;
+	}
+
+	(*found)->nNumPins--;
+	(*found)->bDirty |= bDirty;
+}
+
+template<typename R>
+void TRegionStore<R>::Flush()
+{
+	FScopeLock scope(&lock);
+
+	TArray<FIntPoint> unused;
+	for (auto& pair : regions)
+	{
+		auto& region = *pair.Value;
+
+		if (region.bDirty)
+		{
+			region.file.Flush();
+			region.bDirty = false;
+		}
+
+		if (region.nNumPins == 0)
+			unused.Push(pair.Key);
+	}
+
+	// Unmapped with the region
+	for (auto& key : unused)
+		regions.Remove(key);
+}
+
+template<typename R>
+int TRegionStore<R>::NumMapped() const
+{
+	FScopeLock scope(&lock);
+
+	int num = 0;
+	for (auto& pair : regions)
+		if (pair.Value->file.IsOpen())
+			num++;
+
+	return num;
+}
+
+template<typename R>
+template<typename T>
+void TRegionStore<R>::Attach(TGridManager<T>& manager)
+{
+	constexpr bool bCopy = std::is_same<T, R>::value;
+	static_assert(bCopy || std::is_same<T, R*>::value || std::is_same<T, void*>::value,
+		"Payload must be the record or a pointer to it");
+
+	auto onCreate = manager.GetCreateHook();
+	auto onRelease = manager.GetReleaseHook();
+
+	manager.SetPayloadHooks(
+		[this, onCreate](TCell<T>& c)
+		{
+			R* record = Pin(c.GetIndex());
+
+			if constexpr (bCopy)
+			{
+				if (record)
+					c.GetData() = *record;
+			}
+			else
+				c.GetData() = record;
+
+			if (onCreate)
+				onCreate(c);
+		},
+		[this, onRelease](TCell<T>& c)
+		{
+			if (onRelease)
+				onRelease(c);
+
+			R* record = Find(c.GetIndex());
+
+			if constexpr (bCopy)
+			{
+				if (record)
+					*record = c.GetData();
+			}
+			// Region could be unmapped by the time the payload is looked at.
+			// A payload replaced by someone else is theirs to keep
+			else if (c.GetData() == record)
+				c.GetData() = nullptr;
+
+			Unpin(c.GetIndex(), true);
+		});
+}
+}
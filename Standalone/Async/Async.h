@@ -0,0 +1,97 @@
+#pragma once
+// Stand-in for the engine AsyncTask. Tasks run in FIFO order on a pool of
+// background threads started on first use
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CoreMinimal.h"
+
+namespace ENamedThreads
+{
+	enum Type
+	{
+		AnyThread,
+		AnyBackgroundThreadNormalTask,
+		AnyHiPriThreadNormalTask
+	};
+}
+
+class FBackgroundTaskPool
+{
+public:
+	static FBackgroundTaskPool& Get()
+	{
+		static FBackgroundTaskPool pool;
+		return pool;
+	}
+
+	void Push(TUniqueFunction<void()> task)
+	{
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			tasks.push_back(std::move(task));
+		}
+		wake.notify_one();
+	}
+
+private:
+	FBackgroundTaskPool()
+	{
+		// ASYNCTASK_THREADS overrides the number of background threads
+		int numThreads = (int)std::thread::hardware_concurrency() - 1;
+		if (const char* env = std::getenv("ASYNCTASK_THREADS"))
+			numThreads = std::atoi(env);
+
+		for (int i = 0; i < std::max(numThreads, 1); i++)
+			workers.emplace_back([this] { Loop(); });
+	}
+
+	~FBackgroundTaskPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			bStop = true;
+		}
+		wake.notify_all();
+
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	void Loop()
+	{
+		for (;;)
+		{
+			TUniqueFunction<void()> task;
+			{
+				std::unique_lock<std::mutex> guard(mutex);
+				wake.wait(guard, [this] { return bStop || !tasks.empty(); });
+
+				if (tasks.empty())
+					return;
+
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+
+			task();
+		}
+	}
+
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<TUniqueFunction<void()>> tasks;
+	bool bStop = false;
+};
+
+inline void AsyncTask(ENamedThreads::Type /*thread*/, TUniqueFunction<void()> function)
+{
+	FBackgroundTaskPool::Get().Push(std::move(function));
+}
@@ -0,0 +1,134 @@
+#pragma once
+// Stand-in for the engine ParallelFor. Work is spread over a pool of worker
+// threads started on first use, the calling thread takes part as well
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CoreMinimal.h"
+
+class FParallelForPool
+{
+public:
+	static FParallelForPool& Get()
+	{
+		static FParallelForPool pool;
+		return pool;
+	}
+
+	int32 NumWorkers() const
+	{
+		return (int32)workers.size();
+	}
+
+	// Returns false when the pool is busy with another loop, e.g. for a nested call
+	bool TryRun(int32 num, const TFunctionRef<void(int32)>& body)
+	{
+		std::unique_lock<std::mutex> running(runMutex, std::try_to_lock);
+		if (!running.owns_lock())
+			return false;
+
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			job = &body;
+			jobNum = num;
+			next = 0;
+			pending = (int32)workers.size();
+			generation++;
+		}
+		wake.notify_all();
+
+		Work(body, num);
+
+		std::unique_lock<std::mutex> guard(mutex);
+		done.wait(guard, [this] { return pending == 0; });
+		job = nullptr;
+
+		return true;
+	}
+
+private:
+	FParallelForPool()
+	{
+		// PARALLELFOR_THREADS overrides the number of threads, the caller included
+		unsigned int numThreads = std::thread::hardware_concurrency();
+		if (const char* env = std::getenv("PARALLELFOR_THREADS"))
+			numThreads = (unsigned int)std::atoi(env);
+
+		for (unsigned int i = 1; i < numThreads; i++)
+			workers.emplace_back([this] { Loop(); });
+	}
+
+	~FParallelForPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			bStop = true;
+			generation++;
+		}
+		wake.notify_all();
+
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	void Loop()
+	{
+		uint64 seen = 0;
+		for (;;)
+		{
+			const TFunctionRef<void(int32)>* body = nullptr;
+			int32 num = 0;
+			{
+				std::unique_lock<std::mutex> guard(mutex);
+				wake.wait(guard, [&] { return generation != seen; });
+				seen = generation;
+
+				if (bStop)
+					return;
+
+				body = job;
+				num = jobNum;
+			}
+
+			Work(*body, num);
+
+			std::lock_guard<std::mutex> guard(mutex);
+			if (--pending == 0)
+				done.notify_one();
+		}
+	}
+
+	void Work(const TFunctionRef<void(int32)>& body, int32 num)
+	{
+		for (int32 i = next++; i < num; i = next++)
+			body(i);
+	}
+
+	std::vector<std::thread> workers;
+
+	std::mutex runMutex;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	const TFunctionRef<void(int32)>* job = nullptr;
+	int32 jobNum = 0;
+	std::atomic<int32> next{ 0 };
+	int32 pending = 0;
+	uint64 generation = 0;
+	bool bStop = false;
+};
+
+inline void ParallelFor(int32 num, TFunctionRef<void(int32)> body, bool bForceSingleThread = false)
+{
+	if (!bForceSingleThread && num > 1 && FParallelForPool::Get().NumWorkers() > 0)
+		if (FParallelForPool::Get().TryRun(num, body))
+			return;
+
+	for (int32 i = 0; i < num; i++)
+		body(i);
+}
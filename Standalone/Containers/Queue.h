@@ -0,0 +1,52 @@
+#pragma once
+// Stand-in for the engine queue, guarded by a mutex instead of being lock free
+#include <deque>
+#include <mutex>
+
+#include "CoreMinimal.h"
+
+enum class EQueueMode
+{
+	Mpsc,	// multiple producers, single consumer
+	Spsc	// single producer, single consumer
+};
+
+template<typename T, EQueueMode Mode = EQueueMode::Spsc>
+class TQueue
+{
+public:
+	bool Enqueue(const T& item)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		items.push_back(item);
+		return true;
+	}
+
+	bool Enqueue(T&& item)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		items.push_back(std::move(item));
+		return true;
+	}
+
+	bool Dequeue(T& out)
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		if (items.empty())
+			return false;
+
+		out = std::move(items.front());
+		items.pop_front();
+		return true;
+	}
+
+	bool IsEmpty() const
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		return items.empty();
+	}
+
+private:
+	mutable std::mutex mutex;
+	std::deque<T> items;
+};
@@ -0,0 +1,550 @@
+#pragma once
+// Minimal stand-in for the Unreal Engine core types used by the library,
+// implemented on top of the STL so it can be built without the engine.
+// Only the subset of the engine API the library relies on is provided.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+typedef uint8_t		uint8;
+typedef uint16_t	uint16;
+typedef uint32_t	uint32;
+typedef uint64_t	uint64;
+typedef int8_t		int8;
+typedef int16_t		int16;
+typedef int32_t		int32;
+typedef int64_t		int64;
+
+// Platform flags the engine build defines
+#if defined(_WIN32)
+#define PLATFORM_WINDOWS 1
+#else
+#define PLATFORM_WINDOWS 0
+#endif
+
+#if defined(__linux__)
+#define PLATFORM_LINUX 1
+#else
+#define PLATFORM_LINUX 0
+#endif
+
+#if defined(__APPLE__)
+#define PLATFORM_MAC 1
+#else
+#define PLATFORM_MAC 0
+#endif
+
+#define TEXT(x) x
+#define TCHAR_TO_UTF8(x) (x)
+#define UE_LOG(Category, Verbosity, Format, ...) std::fprintf(stderr, Format "\n", ##__VA_ARGS__)
+#define check(expr) ((void)0)
+#define checkf(expr, ...) ((void)0)
+
+#if defined(_MSC_VER)
+#define FORCENOINLINE __declspec(noinline)
+#else
+#define FORCENOINLINE __attribute__((noinline))
+#endif
+
+template<typename T>
+typename std::remove_reference<T>::type&& MoveTemp(T&& v)
+{
+	return std::move(v);
+}
+
+template<typename T>
+struct TIsPointer
+{
+	enum { Value = std::is_pointer<T>::value };
+};
+
+template<typename F>
+using TFunction = std::function<F>;
+
+template<typename F>
+using TFunctionRef = std::function<F>;
+
+template<typename F>
+using TUniqueFunction = std::function<F>;
+
+struct FPlatformProcess
+{
+	static void Sleep(float seconds)
+	{
+		if (seconds <= 0.0f)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::duration<float>(seconds));
+	}
+};
+
+struct FPlatformTime
+{
+	static uint64 Cycles64()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static double GetSecondsPerCycle64()
+	{
+		return 1e-9;
+	}
+};
+
+struct FMemory
+{
+	static void Memzero(void* dest, size_t count) { std::memset(dest, 0, count); }
+};
+
+// Hashing
+
+inline uint32 HashCombine(uint32 a, uint32 c)
+{
+	return a ^ (c + 0x9e3779b9u + (a << 6) + (a >> 2));
+}
+
+inline uint32 GetTypeHash(int32 v) { return (uint32)v; }
+inline uint32 GetTypeHash(uint32 v) { return v; }
+
+template<typename T>
+inline uint32 GetTypeHash(T* p)
+{
+	return (uint32)(std::hash<T*>()(p));
+}
+
+template<typename T>
+struct THashOf
+{
+	size_t operator()(const T& v) const { return GetTypeHash(v); }
+};
+
+// Math
+
+struct FIntPoint
+{
+	int32 X = 0;
+	int32 Y = 0;
+
+	FIntPoint() {}
+	FIntPoint(int32 x, int32 y) : X(x), Y(y) {}
+
+	FIntPoint operator+(const FIntPoint& o) const { return FIntPoint(X + o.X, Y + o.Y); }
+	FIntPoint operator-(const FIntPoint& o) const { return FIntPoint(X - o.X, Y - o.Y); }
+	FIntPoint& operator+=(const FIntPoint& o) { X += o.X; Y += o.Y; return *this; }
+	FIntPoint& operator-=(const FIntPoint& o) { X -= o.X; Y -= o.Y; return *this; }
+	bool operator==(const FIntPoint& o) const { return X == o.X && Y == o.Y; }
+	bool operator!=(const FIntPoint& o) const { return !(*this == o); }
+};
+
+inline uint32 GetTypeHash(const FIntPoint& p)
+{
+	return HashCombine((uint32)p.X * 0x9E3779B1u, (uint32)p.Y);
+}
+
+struct FIntVector
+{
+	int32 X = 0;
+	int32 Y = 0;
+	int32 Z = 0;
+
+	FIntVector() {}
+	FIntVector(int32 x, int32 y, int32 z) : X(x), Y(y), Z(z) {}
+
+	FIntVector operator+(const FIntVector& o) const { return FIntVector(X + o.X, Y + o.Y, Z + o.Z); }
+	FIntVector operator-(const FIntVector& o) const { return FIntVector(X - o.X, Y - o.Y, Z - o.Z); }
+	bool operator==(const FIntVector& o) const { return X == o.X && Y == o.Y && Z == o.Z; }
+	bool operator!=(const FIntVector& o) const { return !(*this == o); }
+};
+
+inline uint32 GetTypeHash(const FIntVector& p)
+{
+	return HashCombine(HashCombine((uint32)p.X * 0x9E3779B1u, (uint32)p.Y), (uint32)p.Z);
+}
+
+struct FMath
+{
+	template<typename T> static T Abs(T v) { return v < 0 ? -v : v; }
+	template<typename T> static T Sign(T v) { return (T)((v > 0) - (v < 0)); }
+	template<typename T> static T Min(T a, T b) { return a < b ? a : b; }
+	template<typename T> static T Max(T a, T b) { return a > b ? a : b; }
+	template<typename T> static T Clamp(T v, T lo, T hi) { return v < lo ? lo : (v > hi ? hi : v); }
+	static float Sqrt(float v) { return std::sqrt(v); }
+};
+
+// Strings
+
+class FString
+{
+public:
+	FString() {}
+	FString(const char* s) : str(s) {}
+
+	bool operator==(const FString& o) const { return str == o.str; }
+	const char* operator*() const { return str.c_str(); }
+
+	template<typename... Args>
+	static FString Printf(const char* format, Args... args)
+	{
+		FString out;
+		int len = std::snprintf(nullptr, 0, format, args...);
+		if (len > 0)
+		{
+			out.str.resize(len + 1);
+			std::snprintf(&out.str[0], len + 1, format, args...);
+			out.str.resize(len);
+		}
+		return out;
+	}
+
+	std::string str;
+};
+
+inline uint32 GetTypeHash(const FString& s)
+{
+	return (uint32)std::hash<std::string>()(s.str);
+}
+
+// Containers
+
+template<typename T>
+class TArray
+{
+public:
+	typedef typename std::vector<T>::iterator Iterator;
+	typedef typename std::vector<T>::const_iterator ConstIterator;
+
+	TArray() {}
+	TArray(std::initializer_list<T> list) : items(list) {}
+
+	int32 Num() const { return (int32)items.size(); }
+
+	int32 Add(const T& v) { items.push_back(v); return Num() - 1; }
+	int32 Add(T&& v) { items.push_back(std::move(v)); return Num() - 1; }
+	void Push(const T& v) { items.push_back(v); }
+	void Push(T&& v) { items.push_back(std::move(v)); }
+
+	template<typename... Args>
+	int32 Emplace(Args&&... args) { items.emplace_back(std::forward<Args>(args)...); return Num() - 1; }
+
+	T Pop() { T v = std::move(items.back()); items.pop_back(); return v; }
+	void Append(const TArray& o) { items.insert(items.end(), o.items.begin(), o.items.end()); }
+
+	T& operator[](int32 i) { return items[i]; }
+	const T& operator[](int32 i) const { return items[i]; }
+	T& Last() { return items.back(); }
+	const T& Last() const { return items.back(); }
+	T* GetData() { return items.data(); }
+	const T* GetData() const { return items.data(); }
+
+	void Reset() { items.clear(); }
+	void Empty() { items.clear(); items.shrink_to_fit(); }
+	void Reserve(int32 n) { items.reserve(n); }
+	void SetNum(int32 n) { items.resize(n); }
+	void Init(const T& v, int32 n) { items.assign(n, v); }
+
+	template<typename P>
+	int32 RemoveAll(P pred)
+	{
+		size_t before = items.size();
+		items.erase(std::remove_if(items.begin(), items.end(), pred), items.end());
+		return (int32)(before - items.size());
+	}
+
+	int32 Remove(const T& v) { return RemoveAll([&](const T& x) { return x == v; }); }
+	int32 RemoveSwap(const T& v)
+	{
+		int32 removed = 0;
+		for (size_t i = 0; i < items.size();)
+		{
+			if (items[i] == v)
+			{
+				std::swap(items[i], items.back());
+				items.pop_back();
+				removed++;
+			}
+			else
+				i++;
+		}
+		return removed;
+	}
+
+	void RemoveAt(int32 i) { items.erase(items.begin() + i); }
+	void RemoveAtSwap(int32 i) { std::swap(items[i], items.back()); items.pop_back(); }
+
+	bool Contains(const T& v) const { return std::find(items.begin(), items.end(), v) != items.end(); }
+
+	int32 Find(const T& v) const
+	{
+		auto it = std::find(items.begin(), items.end(), v);
+		return it == items.end() ? -1 : (int32)(it - items.begin());
+	}
+
+	template<typename P>
+	TArray FilterByPredicate(P pred) const
+	{
+		TArray result;
+		for (const T& v : items)
+			if (pred(v))
+				result.items.push_back(v);
+		return result;
+	}
+
+	template<typename P>
+	void Sort(P pred) { std::sort(items.begin(), items.end(), pred); }
+
+	Iterator begin() { return items.begin(); }
+	Iterator end() { return items.end(); }
+	ConstIterator begin() const { return items.begin(); }
+	ConstIterator end() const { return items.end(); }
+
+private:
+	std::vector<T> items;
+};
+
+template<typename T>
+class TArrayView
+{
+public:
+	TArrayView() {}
+	TArrayView(const T* data, int32 num) : pData(data), nNum(num) {}
+	TArrayView(const TArray<T>& a) : pData(a.GetData()), nNum(a.Num()) {}
+
+	int32 Num() const { return nNum; }
+	const T& operator[](int32 i) const { return pData[i]; }
+	const T* begin() const { return pData; }
+	const T* end() const { return pData + nNum; }
+
+private:
+	const T* pData = nullptr;
+	int32 nNum = 0;
+};
+
+template<typename K, typename V>
+struct TPair
+{
+	K Key;
+	V Value;
+};
+
+template<typename K, typename V>
+class TMap
+{
+	typedef std::unordered_map<K, TPair<K, V>, THashOf<K>> Storage;
+
+public:
+	struct Iterator
+	{
+		typename Storage::iterator it;
+
+		TPair<K, V>& operator*() const { return it->second; }
+		TPair<K, V>* operator->() const { return &it->second; }
+		Iterator& operator++() { ++it; return *this; }
+		bool operator!=(const Iterator& o) const { return it != o.it; }
+	};
+
+	struct ConstIterator
+	{
+		typename Storage::const_iterator it;
+
+		const TPair<K, V>& operator*() const { return it->second; }
+		const TPair<K, V>* operator->() const { return &it->second; }
+		ConstIterator& operator++() { ++it; return *this; }
+		bool operator!=(const ConstIterator& o) const { return it != o.it; }
+	};
+
+	TMap() {}
+	TMap(std::initializer_list<std::pair<K, V>> list)
+	{
+		for (auto& e : list)
+			Add(e.first, e.second);
+	}
+
+	V& Add(const K& key, const V& value)
+	{
+		TPair<K, V>& e = items[key];
+		e.Key = key;
+		e.Value = value;
+		return e.Value;
+	}
+
+	V& Add(const K& key)
+	{
+		TPair<K, V>& e = items[key];
+		e.Key = key;
+		return e.Value;
+	}
+
+	V& FindOrAdd(const K& key)
+	{
+		auto it = items.find(key);
+		return it != items.end() ? it->second.Value : Add(key);
+	}
+
+	V* Find(const K& key)
+	{
+		auto it = items.find(key);
+		return it == items.end() ? nullptr : &it->second.Value;
+	}
+
+	const V* Find(const K& key) const
+	{
+		auto it = items.find(key);
+		return it == items.end() ? nullptr : &it->second.Value;
+	}
+
+	bool Contains(const K& key) const { return items.count(key) != 0; }
+	int32 Remove(const K& key) { return (int32)items.erase(key); }
+	int32 Num() const { return (int32)items.size(); }
+	void Reset() { items.clear(); }
+	void Empty() { items.clear(); }
+
+	Iterator begin() { return Iterator{ items.begin() }; }
+	Iterator end() { return Iterator{ items.end() }; }
+	ConstIterator begin() const { return ConstIterator{ items.begin() }; }
+	ConstIterator end() const { return ConstIterator{ items.end() }; }
+
+private:
+	Storage items;
+};
+
+template<typename T>
+class TSet
+{
+public:
+	void Add(const T& v) { items.insert(v); }
+	bool Contains(const T& v) const { return items.count(v) != 0; }
+	int32 Remove(const T& v) { return (int32)items.erase(v); }
+	int32 Num() const { return (int32)items.size(); }
+	void Reset() { items.clear(); }
+	void Empty() { items.clear(); }
+
+	typename std::unordered_set<T, THashOf<T>>::const_iterator begin() const { return items.begin(); }
+	typename std::unordered_set<T, THashOf<T>>::const_iterator end() const { return items.end(); }
+
+private:
+	std::unordered_set<T, THashOf<T>> items;
+};
+
+// Smart pointers
+
+// std::shared_ptr always counts atomically, the mode only keeps pointer types apart like UE4 does.
+// So the shim cannot catch ESPMode misuse: a Fast pointer copied across threads works here
+// but races inside the engine. Check thread safe paths against the engine build
+enum class ESPMode
+{
+	NotThreadSafe = 0,
+	Fast = 0,
+	ThreadSafe = 1
+};
+
+template<typename T, ESPMode Mode = ESPMode::Fast> class TWeakPtr;
+
+// Returned by MakeShareable, converts to a shared pointer of any mode
+template<typename T>
+struct FRawPtrProxy
+{
+	T* Object;
+};
+
+template<typename T, ESPMode Mode = ESPMode::Fast>
+class TSharedPtr
+{
+public:
+	TSharedPtr() {}
+	TSharedPtr(std::nullptr_t) {}
+	explicit TSharedPtr(std::shared_ptr<T> p) : ptr(std::move(p)) {}
+
+	template<typename U>
+	TSharedPtr(const FRawPtrProxy<U>& p) : ptr(p.Object) {}
+
+	template<typename U>
+	TSharedPtr(const TSharedPtr<U, Mode>& o) : ptr(o.ptr) {}
+
+	// Aliasing: shares ownership with o but points to obj
+	template<typename U>
+	TSharedPtr(const TSharedPtr<U, Mode>& o, T* obj) : ptr(o.ptr, obj) {}
+
+	bool IsValid() const { return (bool)ptr; }
+	explicit operator bool() const { return (bool)ptr; }
+
+	T* Get() const { return ptr.get(); }
+	T* operator->() const { return ptr.get(); }
+	T& operator*() const { return *ptr; }
+
+	void Reset() { ptr.reset(); }
+	int32 GetSharedReferenceCount() const { return (int32)ptr.use_count(); }
+
+	bool operator==(const TSharedPtr& o) const { return ptr == o.ptr; }
+	bool operator!=(const TSharedPtr& o) const { return ptr != o.ptr; }
+	bool operator==(std::nullptr_t) const { return !ptr; }
+	bool operator!=(std::nullptr_t) const { return (bool)ptr; }
+
+private:
+	template<typename U, ESPMode M> friend class TSharedPtr;
+	template<typename U, ESPMode M> friend class TWeakPtr;
+
+	std::shared_ptr<T> ptr;
+};
+
+template<typename T, ESPMode Mode>
+inline uint32 GetTypeHash(const TSharedPtr<T, Mode>& p)
+{
+	return GetTypeHash(p.Get());
+}
+
+template<typename T, ESPMode Mode>
+class TWeakPtr
+{
+public:
+	TWeakPtr() {}
+	TWeakPtr(const TSharedPtr<T, Mode>& p) : ptr(p.ptr) {}
+
+	TSharedPtr<T, Mode> Pin() const { return TSharedPtr<T, Mode>(ptr.lock()); }
+	bool IsValid() const { return !ptr.expired(); }
+	void Reset() { ptr.reset(); }
+
+private:
+	std::weak_ptr<T> ptr;
+};
+
+template<typename T>
+FRawPtrProxy<T> MakeShareable(T* obj)
+{
+	return FRawPtrProxy<T>{ obj };
+}
+
+template<typename T, ESPMode Mode = ESPMode::Fast, typename... Args>
+TSharedPtr<T, Mode> MakeShared(Args&&... args)
+{
+	return TSharedPtr<T, Mode>(std::make_shared<T>(std::forward<Args>(args)...));
+}
+
+template<typename T>
+class TUniquePtr : public std::unique_ptr<T>
+{
+public:
+	using std::unique_ptr<T>::unique_ptr;
+
+	T* Get() const { return this->get(); }
+	bool IsValid() const { return this->get() != nullptr; }
+	void Reset() { this->reset(); }
+};
+
+template<typename T, typename... Args>
+TUniquePtr<T> MakeUnique(Args&&... args)
+{
+	return TUniquePtr<T>(new T(std::forward<Args>(args)...));
+}
@@ -0,0 +1,36 @@
+#pragma once
+// Stand-in for the engine critical section and its scope guard
+#include <mutex>
+
+#include "CoreMinimal.h"
+
+class FCriticalSection
+{
+public:
+	void Lock() { mutex.lock(); }
+	bool TryLock() { return mutex.try_lock(); }
+	void Unlock() { mutex.unlock(); }
+
+private:
+	std::mutex mutex;
+};
+
+class FScopeLock
+{
+public:
+	explicit FScopeLock(FCriticalSection* InSynchObject) : SynchObject(InSynchObject)
+	{
+		SynchObject->Lock();
+	}
+
+	~FScopeLock()
+	{
+		SynchObject->Unlock();
+	}
+
+	FScopeLock(const FScopeLock&) = delete;
+	FScopeLock& operator=(const FScopeLock&) = delete;
+
+private:
+	FCriticalSection* SynchObject;
+};
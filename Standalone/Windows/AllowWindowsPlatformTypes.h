@@ -0,0 +1,8 @@
+#pragma once
+// Stand-in for the engine header, keeps windows.h from defining min and max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
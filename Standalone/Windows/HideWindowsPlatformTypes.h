@@ -0,0 +1,2 @@
+#pragma once
+// Stand-in for the engine header, nothing to undo in the standalone build
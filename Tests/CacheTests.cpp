@@ -0,0 +1,188 @@
+// Released payloads kept by the cell cache and revived instead of created again
+#include "DynamicGrid.h"
+#include "Test.h"
+
+#include <vector>
+
+using namespace serenity;
+
+namespace
+{
+	typedef TGridManager<int> Manager;
+	typedef TSharedPtr<TCell<int>, ESPMode::ThreadSafe> CellPtr;
+
+	// Payload derived from the index, so a revived cell shows where it came from
+	int Encode(FIntPoint index)
+	{
+		return (index.X + 5000) * 10000 + (index.Y + 5000);
+	}
+
+	// Created cells get their encoded index, revived ones must still have it
+	class CountingSink : public TCountingSink<int>
+	{
+	public:
+		CountingSink()
+		{
+			onCreated = [](const CellPtr& cell)
+			{
+				EXPECT(cell->GetData() == 0);
+				cell->GetData() = Encode(cell->GetIndex());
+			};
+			onDeleted = [](const int& data) { EXPECT(data != 0); };
+			onRevived = [](const CellPtr& cell) { EXPECT(cell->GetData() == Encode(cell->GetIndex())); };
+		}
+	};
+
+	void TestRevive()
+	{
+		Manager manager;
+		CountingSink sink;
+		manager.SetCellCache(1000);
+
+		auto g = manager.CreateGrid(GridStorage::LINKED);
+		g->Init(FIntPoint(0, 0), 3, sink);
+		g->MoveTo(FIntPoint(10, 0), sink);
+		EXPECT(sink.numCreated == 50);
+		EXPECT(sink.numDeleted == 0);
+		EXPECT(manager.NumCachedCells() == 25);
+
+		// Coming back revives every cell instead of creating it
+		g->MoveTo(FIntPoint(0, 0), sink);
+		EXPECT(sink.numRevived == 25);
+		EXPECT(sink.numCreated == 50);
+		EXPECT(manager.GetCellStats().numCached == 25);
+
+		manager.EmptyCellCache(sink);
+		EXPECT(sink.numDeleted == 25);
+		EXPECT(manager.NumCachedCells() == 0);
+
+		// Cells of a destroyed grid are cached as well, turning the cache off keeps them
+		manager.DestroyGrid(g, sink);
+		EXPECT(sink.numDeleted == 25);
+		EXPECT(manager.NumCachedCells() == 25);
+		manager.SetCellCache(0);
+		EXPECT(manager.NumCachedCells() == 25);
+		manager.EmptyCellCache(sink);
+		EXPECT(sink.numDeleted == 50);
+	}
+
+	void TestLimits()
+	{
+		Manager manager;
+		CountingSink sink;
+		manager.SetCellCache(10);
+
+		auto g = manager.CreateGrid(GridStorage::RING);
+		g->Init(FIntPoint(0, 0), 3, sink);
+		g->MoveTo(FIntPoint(100, 0), sink);
+		EXPECT(manager.NumCachedCells() == 10);
+		EXPECT(sink.numDeleted == 15);
+
+		manager.SetCellCache(100, 7 * 4, [](const int&) { return int64(4); });
+		g->MoveTo(FIntPoint(200, 0), sink);
+		EXPECT(manager.NumCachedCells() == 7);
+		EXPECT(sink.numDeleted == 15 + 10 + 25 - 7);
+
+		manager.SetCellCache(100, 3, [](const int&) { return int64(4); });
+		g->MoveTo(FIntPoint(300, 0), sink);
+		EXPECT(manager.NumCachedCells() == 0);
+		EXPECT(sink.numCreated - sink.numDeleted == 25);
+	}
+
+	// Release hook does not see a cached payload until it is evicted
+	void TestHooks()
+	{
+		Manager manager;
+		CountingSink sink;
+		int numCreateHooks = 0;
+		int numReleaseHooks = 0;
+		manager.SetPayloadHooks([&](TCell<int>&) { numCreateHooks++; }, [&](TCell<int>& c)
+		{
+			numReleaseHooks++;
+			EXPECT(c.GetData() == Encode(c.GetIndex()));
+		});
+		manager.SetCellCache(5);
+
+		// A grid of radius 2 at the corner of four 16x16 chunks holds all four
+		auto g = manager.CreateGrid(GridStorage::CHUNKED);
+		g->Init(FIntPoint(0, 0), 2, sink);
+		g->MoveTo(FIntPoint(40, 0), sink);
+		EXPECT(numReleaseHooks == 1024 - 5);
+		EXPECT(numCreateHooks == 1536);
+
+		g->MoveTo(FIntPoint(0, 0), sink);
+		EXPECT(sink.numRevived == 5);
+		EXPECT(numCreateHooks == 1536 + 1019);
+	}
+
+	// Random walks with prefetch and hysteresis, moved one by one, by MoveAll and concurrently
+	void TestWalks(int mode)
+	{
+		Manager manager;
+		CountingSink sink;
+		manager.SetConcurrent(mode == 2);
+		manager.SetCellCache(300);
+
+		std::vector<Manager::GridPtr> grids;
+		std::vector<FIntPoint> positions;
+		for (int i = 0; i < 6; i++)
+		{
+			grids.push_back(manager.CreateGrid((GridStorage)(i % 3)));
+			positions.push_back(FIntPoint(i * 40, 0));
+			grids[i]->SetPrefetch(i % 2);
+			grids[i]->SetHysteresis(i % 3);
+			grids[i]->Init(positions[i], 2 + i % 3, sink);
+		}
+
+		FTestRandom random(3);
+
+		for (int step = 0; step < 400; step++)
+		{
+			TArray<Manager::Move> moves;
+			for (size_t i = 0; i < grids.size(); i++)
+			{
+				int k = random.Next() % 10;
+				positions[i] += FIntPoint(k < 3 ? 1 : k < 6 ? -1 : 0, k == 6 ? 1 : k == 7 ? -1 : 0);
+				if (k == 9 && random.Next() % 10 == 0)
+					positions[i] += FIntPoint(50, 0);
+
+				if (mode == 0)
+					grids[i]->MoveTo(positions[i], sink);
+				else
+					moves.Push({ grids[i], positions[i] });
+			}
+
+			if (mode)
+				manager.MoveAll(moves, sink);
+
+			for (auto& g : grids)
+				for (auto& c : g->GetAllCells())
+					EXPECT(c->GetData() == Encode(c->GetIndex()));
+
+			auto stats = manager.GetCellStats();
+			EXPECT(stats.numCached <= 300);
+			EXPECT(sink.numCreated - sink.numDeleted == stats.numLive + stats.numCached);
+		}
+
+		EXPECT(sink.numRevived > 0);
+
+		for (auto& g : grids)
+			manager.DestroyGrid(g, sink);
+		manager.EmptyCellCache(sink);
+
+		EXPECT(sink.numCreated == sink.numDeleted);
+		EXPECT(manager.GetCellStats().numLive == 0);
+	}
+}
+
+int main()
+{
+	TestRevive();
+	TestLimits();
+	TestHooks();
+
+	for (int mode = 0; mode < 3; mode++)
+		TestWalks(mode);
+
+	return FinishTests("CacheTests");
+}
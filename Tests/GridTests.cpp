@@ -0,0 +1,398 @@
+// Ownership of cells shared by grids, checked against the squares the grids cover
+#include "DynamicGrid.h"
+#include "Test.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace serenity;
+
+namespace
+{
+	typedef TGridManager<int> Manager;
+	typedef std::map<std::pair<int, int>, size_t> Owners;
+
+	const GridStorage Storages[] = { GridStorage::LINKED, GridStorage::RING };
+
+	// A grid of radius r covers the square of side 2r - 1 around its position
+	Owners ExpectedOwners(const std::vector<FIntPoint>& positions, const std::vector<int>& radii)
+	{
+		Owners owners;
+		for (size_t i = 0; i < positions.size(); i++)
+			for (int x = 1 - radii[i]; x < radii[i]; x++)
+				for (int y = 1 - radii[i]; y < radii[i]; y++)
+					owners[{ positions[i].X + x, positions[i].Y + y }]++;
+		return owners;
+	}
+
+	// Counts live cells through the payload hooks, a cell created and released
+	// again within one move never shows up in the delivered arrays
+	struct FLiveCount
+	{
+		explicit FLiveCount(Manager& manager)
+		{
+			manager.SetPayloadHooks([this](TCell<int>&) { nNumLive++; }, [this](TCell<int>&) { nNumLive--; });
+		}
+
+		int64 nNumLive = 0;
+	};
+
+	void CheckOwners(const Manager& manager, const FLiveCount& live, const Owners& expected)
+	{
+		for (auto& pair : expected)
+		{
+			auto c = manager.FindCell(pair.first.first, pair.first.second);
+			EXPECT(IsValid(c));
+			if (IsValid(c))
+				EXPECT(c->NumOwners() == pair.second);
+		}
+
+		EXPECT(live.nNumLive == (int64)expected.size());
+	}
+
+	void TestSharedOwners(GridStorage storage)
+	{
+		Manager manager;
+		FLiveCount live(manager);
+
+		auto a = manager.CreateGrid(storage);
+		auto b = manager.CreateGrid(storage);
+		auto da = a->Init(FIntPoint(0, 0), 3);
+		auto db = b->Init(FIntPoint(2, 0), 3);
+
+		// 5x5 squares overlapping by 3 columns
+		EXPECT(da.created.Num() == 25);
+		EXPECT(db.created.Num() == 10);
+		CheckOwners(manager, live, ExpectedOwners({ FIntPoint(0, 0), FIntPoint(2, 0) }, { 3, 3 }));
+
+		EXPECT(a->FindCellByIndex(FIntPoint(1, 1)) == b->FindCellByIndex(FIntPoint(1, 1)));
+		EXPECT(!IsValid(a->FindCellByIndex(FIntPoint(3, 0))));
+		EXPECT(IsValid(b->FindCellByIndex(FIntPoint(3, 0))));
+
+		// Only the cells b had to itself go away
+		auto cleared = b->Clear();
+		EXPECT(cleared.deleted.Num() == 10);
+		CheckOwners(manager, live, ExpectedOwners({ FIntPoint(0, 0) }, { 3 }));
+
+		a->Clear();
+		EXPECT(live.nNumLive == 0);
+	}
+
+	// Random walks and resizes, every step is compared with the squares of all grids
+	void TestMoves(GridStorage storage)
+	{
+		Manager manager;
+		FLiveCount live(manager);
+		FTestRandom random(7);
+
+		std::vector<Manager::GridPtr> grids;
+		std::vector<FIntPoint> positions;
+		std::vector<int> radii;
+		for (int i = 0; i < 6; i++)
+		{
+			grids.push_back(manager.CreateGrid(storage));
+			positions.push_back(FIntPoint(i * 3, i % 2));
+			radii.push_back(1 + i % 4);
+			grids[i]->Init(positions[i], radii[i]);
+		}
+
+		for (int step = 0; step < 200; step++)
+		{
+			for (size_t i = 0; i < grids.size(); i++)
+			{
+				int k = random.Next() % 16;
+				if (k == 0)
+				{
+					radii[i] = random.Range(1, 5);
+					grids[i]->Resize(radii[i]);
+				}
+				else
+				{
+					// Mostly unit steps, now and then a jump
+					positions[i] += k == 1 ? FIntPoint(random.Range(-10, 10), random.Range(-10, 10)) : FIntPoint(random.Range(-1, 1), random.Range(-1, 1));
+					grids[i]->MoveTo(positions[i]);
+				}
+			}
+
+			CheckOwners(manager, live, ExpectedOwners(positions, radii));
+		}
+
+		for (auto& g : grids)
+			g->Clear();
+
+		EXPECT(live.nNumLive == 0);
+	}
+
+	// A CHUNKED grid owns every cell of the pool regions under its square,
+	// including the ones in edge regions that are out of the square
+	Owners ExpectedChunkOwners(const std::vector<FIntPoint>& positions, const std::vector<int>& radii)
+	{
+		const int side = TCellPool<int>::SlabSide;
+
+		Owners owners;
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			auto min = TCellPool<int>::GetRegion(positions[i] - FIntPoint(radii[i] - 1, radii[i] - 1));
+			auto max = TCellPool<int>::GetRegion(positions[i] + FIntPoint(radii[i] - 1, radii[i] - 1));
+			for (int x = min.X * side; x < (max.X + 1) * side; x++)
+				for (int y = min.Y * side; y < (max.Y + 1) * side; y++)
+					owners[{ x, y }]++;
+		}
+		return owners;
+	}
+
+	// Radii past the limit of the other storages, walked and resized like in TestMoves
+	void TestChunkedMoves()
+	{
+		Manager manager;
+		FLiveCount live(manager);
+		FTestRandom random(11);
+
+		std::vector<Manager::GridPtr> grids;
+		std::vector<FIntPoint> positions;
+		std::vector<int> radii;
+		for (int i = 0; i < 4; i++)
+		{
+			grids.push_back(manager.CreateGrid(GridStorage::CHUNKED));
+			positions.push_back(FIntPoint(i * 40 - 60, i * 7));
+			radii.push_back(17 + i * 15);
+			grids[i]->Init(positions[i], radii[i]);
+			EXPECT(grids[i]->GetRadius() == radii[i]);
+		}
+
+		CheckOwners(manager, live, ExpectedChunkOwners(positions, radii));
+
+		for (int step = 0; step < 40; step++)
+		{
+			for (size_t i = 0; i < grids.size(); i++)
+			{
+				int k = random.Next() % 8;
+				if (k == 0)
+				{
+					radii[i] = random.Range(17, 80);
+					grids[i]->Resize(radii[i]);
+				}
+				else
+				{
+					positions[i] += k == 1 ? FIntPoint(random.Range(-100, 100), random.Range(-100, 100)) : FIntPoint(random.Range(-9, 9), random.Range(-9, 9));
+					grids[i]->MoveTo(positions[i]);
+				}
+
+				// Cells of the grid still describe its square
+				EXPECT(grids[i]->GetAllCells().Num() == (2 * radii[i] - 1) * (2 * radii[i] - 1));
+			}
+
+			CheckOwners(manager, live, ExpectedChunkOwners(positions, radii));
+		}
+
+		for (auto& g : grids)
+			g->Clear();
+
+		EXPECT(live.nNumLive == 0);
+	}
+
+	// A disc of radius r holds the cells whose offset has x^2 + y^2 <= (r-1)^2 + (r-1)
+	bool InDisc(FIntPoint offset, int radius)
+	{
+		int r = radius - 1;
+		return offset.X * offset.X + offset.Y * offset.Y <= r * r + r;
+	}
+
+	Owners ExpectedDiscOwners(const std::vector<FIntPoint>& positions, const std::vector<int>& radii, GridStorage storage)
+	{
+		const int side = TCellPool<int>::SlabSide;
+
+		Owners owners;
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			if (storage != GridStorage::CHUNKED)
+			{
+				for (int x = 1 - radii[i]; x < radii[i]; x++)
+					for (int y = 1 - radii[i]; y < radii[i]; y++)
+						if (InDisc(FIntPoint(x, y), radii[i]))
+							owners[{ positions[i].X + x, positions[i].Y + y }]++;
+				continue;
+			}
+
+			// Whole regions that hold at least one cell of the disc
+			auto min = TCellPool<int>::GetRegion(positions[i] - FIntPoint(radii[i] - 1, radii[i] - 1));
+			auto max = TCellPool<int>::GetRegion(positions[i] + FIntPoint(radii[i] - 1, radii[i] - 1));
+			for (int rx = min.X; rx <= max.X; rx++)
+				for (int ry = min.Y; ry <= max.Y; ry++)
+				{
+					bool bTouched = false;
+					for (int x = rx * side; x < (rx + 1) * side && !bTouched; x++)
+						for (int y = ry * side; y < (ry + 1) * side && !bTouched; y++)
+							bTouched = InDisc(FIntPoint(x, y) - positions[i], radii[i]);
+
+					if (bTouched)
+						for (int x = rx * side; x < (rx + 1) * side; x++)
+							for (int y = ry * side; y < (ry + 1) * side; y++)
+								owners[{ x, y }]++;
+				}
+		}
+		return owners;
+	}
+
+	// Cells right on and right past the edge of the disc
+	void TestDiscBoundary(GridStorage storage)
+	{
+		Manager manager;
+		FLiveCount live(manager);
+
+		auto g = manager.CreateGrid(storage, GridShape::DISC);
+		g->Init(FIntPoint(10, -4), 4);
+
+		// Radius 4: offsets up to 3 along the axes, (3, 1) and (2, 2) are in, (3, 2) is not
+		for (FIntPoint offset : { FIntPoint(0, 0), FIntPoint(3, 0), FIntPoint(0, -3), FIntPoint(3, 1), FIntPoint(-2, 2), FIntPoint(1, -3) })
+			EXPECT(IsValid(g->FindCellByIndex(FIntPoint(10, -4) + offset)));
+		for (FIntPoint offset : { FIntPoint(3, 2), FIntPoint(-2, -3), FIntPoint(3, 3), FIntPoint(4, 0) })
+			EXPECT(!IsValid(g->FindCellByIndex(FIntPoint(10, -4) + offset)));
+
+		EXPECT(g->GetAllCells().Num() == 37);
+		CheckOwners(manager, live, ExpectedDiscOwners({ FIntPoint(10, -4) }, { 4 }, storage));
+
+		// A disc of radius 16 instead of a 31x31 square
+		g->Resize(16);
+		EXPECT(g->GetAllCells().Num() == 749);
+		CheckOwners(manager, live, ExpectedDiscOwners({ FIntPoint(10, -4) }, { 16 }, storage));
+
+		g->Clear();
+		EXPECT(live.nNumLive == 0);
+	}
+
+	// Every move of a lone disc reports exactly the cells of the new disc that are out
+	// of the old one as created, and the ones of the old disc out of the new one as deleted
+	void TestDiscMoves(GridStorage storage)
+	{
+		Manager manager;
+		FLiveCount live(manager);
+		FTestRandom random(5);
+
+		FIntPoint position(0, 0);
+		int radius = 5;
+		auto g = manager.CreateGrid(storage, GridShape::DISC);
+		g->Init(position, radius);
+
+		for (int step = 0; step < 200; step++)
+		{
+			int k = random.Next() % 8;
+			FIntPoint to = position + (k == 0 ? FIntPoint(random.Range(-12, 12), random.Range(-12, 12)) : FIntPoint(random.Range(-1, 1), random.Range(-1, 1)));
+
+			int numEntering = 0;
+			int numLeaving = 0;
+			for (int x = 1 - radius; x < radius; x++)
+				for (int y = 1 - radius; y < radius; y++)
+				{
+					FIntPoint offset(x, y);
+					if (InDisc(offset, radius) && !InDisc(to + offset - position, radius))
+						numEntering++;
+					if (InDisc(offset, radius) && !InDisc(position + offset - to, radius))
+						numLeaving++;
+				}
+
+			auto d = g->MoveTo(to);
+			position = to;
+			EXPECT(d.created.Num() == numEntering);
+			EXPECT(d.deleted.Num() == numLeaving);
+			CheckOwners(manager, live, ExpectedDiscOwners({ position }, { radius }, storage));
+
+			if (k == 1)
+			{
+				radius = random.Range(1, 8);
+				g->Resize(radius);
+				CheckOwners(manager, live, ExpectedDiscOwners({ position }, { radius }, storage));
+			}
+		}
+
+		g->Clear();
+		EXPECT(live.nNumLive == 0);
+	}
+
+	// Discs of all storages walking over each other
+	void TestDiscWalks()
+	{
+		Manager manager;
+		FLiveCount live(manager);
+		FTestRandom random(13);
+
+		const GridStorage storages[] = { GridStorage::LINKED, GridStorage::RING, GridStorage::CHUNKED };
+
+		std::vector<Manager::GridPtr> grids;
+		std::vector<FIntPoint> positions;
+		std::vector<int> radii;
+		for (int i = 0; i < 6; i++)
+		{
+			grids.push_back(manager.CreateGrid(storages[i % 3], GridShape::DISC));
+			positions.push_back(FIntPoint(i * 4, -i));
+			radii.push_back(2 + i % 5);
+			grids[i]->Init(positions[i], radii[i]);
+		}
+
+		for (int step = 0; step < 100; step++)
+		{
+			for (size_t i = 0; i < grids.size(); i++)
+			{
+				positions[i] += random.Next() % 10 == 0 ? FIntPoint(random.Range(-20, 20), random.Range(-20, 20)) : FIntPoint(random.Range(-1, 1), random.Range(-1, 1));
+				grids[i]->MoveTo(positions[i]);
+			}
+
+			// Owners of all discs summed up
+			Owners expected;
+			for (size_t i = 0; i < grids.size(); i++)
+				for (auto& pair : ExpectedDiscOwners({ positions[i] }, { radii[i] }, storages[i % 3]))
+					expected[pair.first] += pair.second;
+
+			CheckOwners(manager, live, expected);
+		}
+
+		for (auto& g : grids)
+			g->Clear();
+
+		EXPECT(live.nNumLive == 0);
+	}
+
+	// Radius of other storages is clamped to 16, CHUNKED grids go far past it.
+	// Its own limit of 4096 is not reached here, that square has 67M cells
+	void TestChunkedLimits()
+	{
+		Manager manager;
+		FLiveCount live(manager);
+
+		auto linked = manager.CreateGrid(GridStorage::LINKED);
+		linked->Init(FIntPoint(0, 0), 100);
+		EXPECT(linked->GetRadius() == 16);
+		linked->Clear();
+
+		// About a million cells, sampled instead of checked one by one
+		auto big = manager.CreateGrid(GridStorage::CHUNKED);
+		big->Init(FIntPoint(5, -3), 512);
+		EXPECT(big->GetRadius() == 512);
+		EXPECT(live.nNumLive == (int64)ExpectedChunkOwners({ FIntPoint(5, -3) }, { 512 }).size());
+		EXPECT(IsValid(big->FindCellByIndex(FIntPoint(5 + 511, -3 - 511))));
+		EXPECT(!IsValid(big->FindCellByIndex(FIntPoint(5 + 512, -3))));
+
+		big->Clear();
+		EXPECT(live.nNumLive == 0);
+	}
+}
+
+int main()
+{
+	for (GridStorage storage : Storages)
+	{
+		TestSharedOwners(storage);
+		TestMoves(storage);
+		TestDiscMoves(storage);
+	}
+
+	for (GridStorage storage : { GridStorage::LINKED, GridStorage::RING, GridStorage::CHUNKED })
+		TestDiscBoundary(storage);
+	TestDiscWalks();
+
+	TestChunkedMoves();
+	TestChunkedLimits();
+
+	return FinishTests("GridTests");
+}
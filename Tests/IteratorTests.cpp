@@ -0,0 +1,151 @@
+// Cell iterators of grids and of the manager, checked against GetAllCells and FindCell
+#include "DynamicGrid.h"
+#include "Test.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace serenity;
+
+namespace
+{
+	typedef TGridManager<int> Manager;
+	typedef TSharedPtr<TCell<int>, ESPMode::ThreadSafe> CellPtr;
+	typedef std::map<std::pair<int, int>, int> Visits;
+
+	void Visit(Visits& visits, const CellPtr& c)
+	{
+		EXPECT(IsValid(c));
+		if (IsValid(c))
+			visits[{ c->GetIndex().X, c->GetIndex().Y }]++;
+	}
+
+	// Every expected cell is visited exactly once and nothing else is
+	void CheckVisits(const Visits& visits, const Visits& expected)
+	{
+		EXPECT(visits.size() == expected.size());
+		for (auto& pair : visits)
+			EXPECT(pair.second == 1 && expected.count(pair.first));
+	}
+
+	int RingDistance(FIntPoint index, FIntPoint center)
+	{
+		return FMath::Max(FMath::Abs(index.X - center.X), FMath::Abs(index.Y - center.Y));
+	}
+
+	void CheckGrid(const Manager::GridPtr& g, FIntPoint min, FIntPoint max, int inner, int outer)
+	{
+		FIntPoint center = g->GetRoot()->GetIndex();
+
+		Visits all, inRect, inRing;
+		for (auto& c : g->GetAllCells())
+		{
+			auto index = c->GetIndex();
+			Visit(all, c);
+			if (index.X >= min.X && index.X <= max.X && index.Y >= min.Y && index.Y <= max.Y)
+				Visit(inRect, c);
+			int d = RingDistance(index, center);
+			if (d >= inner && d <= outer)
+				Visit(inRing, c);
+		}
+
+		Visits visits;
+		g->ForEachCell([&](const CellPtr& c) { Visit(visits, c); });
+		CheckVisits(visits, all);
+
+		visits.clear();
+		g->ForEachCellInRect(min, max, [&](const CellPtr& c) { Visit(visits, c); });
+		CheckVisits(visits, inRect);
+
+		visits.clear();
+		g->ForEachCellInRing(inner, outer, [&](const CellPtr& c) { Visit(visits, c); });
+		CheckVisits(visits, inRing);
+	}
+
+	// The manager visits live cells, shared ones once, whichever grids hold them
+	void CheckManager(const Manager& manager, FIntPoint min, FIntPoint max, FIntPoint center, int inner, int outer)
+	{
+		Visits visits;
+		manager.ForEachCell([&](const CellPtr& c) { Visit(visits, c); });
+		EXPECT((int64)visits.size() == manager.GetCellStats().numLive);
+		for (auto& pair : visits)
+			EXPECT(pair.second == 1 && IsValid(manager.FindCell(pair.first.first, pair.first.second)));
+
+		Visits inRect, inRing;
+		for (int x = FMath::Min(min.X, center.X - outer); x <= FMath::Max(max.X, center.X + outer); x++)
+			for (int y = FMath::Min(min.Y, center.Y - outer); y <= FMath::Max(max.Y, center.Y + outer); y++)
+			{
+				auto c = manager.FindCell(x, y);
+				if (!IsValid(c))
+					continue;
+
+				if (x >= min.X && x <= max.X && y >= min.Y && y <= max.Y)
+					Visit(inRect, c);
+				int d = RingDistance(FIntPoint(x, y), center);
+				if (d >= inner && d <= outer)
+					Visit(inRing, c);
+			}
+
+		visits.clear();
+		manager.ForEachCellInRect(min, max, [&](const CellPtr& c) { Visit(visits, c); });
+		CheckVisits(visits, inRect);
+
+		visits.clear();
+		manager.ForEachCellInRing(center, inner, outer, [&](const CellPtr& c) { Visit(visits, c); });
+		CheckVisits(visits, inRing);
+	}
+
+	// Overlapping grids of every storage and shape walk around, rectangles and rings
+	// of random sizes are checked after every step, slab edges and empty ones included
+	void TestWalks()
+	{
+		Manager manager;
+		FTestRandom random(17);
+
+		const GridStorage storages[] = { GridStorage::LINKED, GridStorage::RING, GridStorage::CHUNKED };
+
+		std::vector<Manager::GridPtr> grids;
+		std::vector<FIntPoint> positions;
+		for (int i = 0; i < 6; i++)
+		{
+			grids.push_back(manager.CreateGrid(storages[i % 3], i < 3 ? GridShape::SQUARE : GridShape::DISC));
+			positions.push_back(FIntPoint(i * 5 - 12, 3 - i * 2));
+			grids[i]->Init(positions[i], 2 + i % 5);
+		}
+
+		for (int step = 0; step < 100; step++)
+		{
+			for (size_t i = 0; i < grids.size(); i++)
+			{
+				positions[i] += random.Next() % 10 == 0 ? FIntPoint(random.Range(-30, 30), random.Range(-30, 30)) : FIntPoint(random.Range(-1, 1), random.Range(-1, 1));
+				grids[i]->MoveTo(positions[i]);
+
+				FIntPoint min = positions[i] + FIntPoint(random.Range(-8, 4), random.Range(-8, 4));
+				FIntPoint max = min + FIntPoint(random.Range(-1, 10), random.Range(-1, 10));
+				int inner = random.Range(0, 4);
+				int outer = inner + random.Range(-1, 4);
+				CheckGrid(grids[i], min, max, inner, outer);
+			}
+
+			FIntPoint min(random.Range(-40, 20), random.Range(-40, 20));
+			FIntPoint max = min + FIntPoint(random.Range(0, 40), random.Range(0, 40));
+			int inner = random.Range(0, 10);
+			CheckManager(manager, min, max, positions[step % grids.size()], inner, inner + random.Range(0, 10));
+		}
+
+		for (auto& g : grids)
+			g->Clear();
+
+		int num = 0;
+		manager.ForEachCell([&](const CellPtr&) { num++; });
+		EXPECT(num == 0);
+	}
+}
+
+int main()
+{
+	TestWalks();
+
+	return FinishTests("IteratorTests");
+}
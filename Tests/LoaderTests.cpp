@@ -0,0 +1,218 @@
+// Payloads loaded on background threads and handed over by PumpLoads
+#include "DynamicGrid.h"
+#include "Test.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace serenity;
+
+namespace
+{
+	typedef TGridManager<int64> Manager;
+
+	int64 Load(FIntPoint index)
+	{
+		return int64(index.X) * 100003 + index.Y;
+	}
+
+	// Pumps until nothing is pending, gives up after about two seconds
+	void Drain(Manager& manager)
+	{
+		for (int i = 0; i < 2000 && manager.NumPendingLoads() > 0; i++)
+		{
+			manager.PumpLoads();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	void TestPump()
+	{
+		Manager manager;
+		int numLoaded = 0;
+		manager.SetLoader(Load, [&](TCell<int64>& c)
+		{
+			numLoaded++;
+			EXPECT(c.GetData() == Load(c.GetIndex()));
+		});
+
+		auto g = manager.CreateGrid(GridStorage::LINKED);
+		g->Init(FIntPoint(0, 0), 3);
+		EXPECT(manager.NumPendingLoads() == 25);
+		for (auto& c : g->GetAllCells())
+			EXPECT(c->GetState() != CellState::UNLOADED);
+
+		// The budget caps the cells handed over by one call
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		EXPECT(manager.PumpLoads(4) == 4);
+		EXPECT(manager.NumPendingLoads() == 21);
+
+		Drain(manager);
+		EXPECT(manager.NumPendingLoads() == 0);
+		EXPECT(numLoaded == 25);
+		for (auto& c : g->GetAllCells())
+		{
+			EXPECT(c->GetState() == CellState::READY);
+			EXPECT(c->GetData() == Load(c->GetIndex()));
+		}
+	}
+
+	// Cells released before their payload arrives never get it
+	void TestReleasedWhileLoading()
+	{
+		Manager manager;
+		std::atomic<bool> bGo{ false };
+		int numLoaded = 0;
+		manager.SetLoader([&](FIntPoint index)
+		{
+			while (!bGo)
+				std::this_thread::yield();
+			return Load(index);
+		},
+		[&](TCell<int64>&) { numLoaded++; });
+
+		auto g = manager.CreateGrid(GridStorage::RING);
+		g->Init(FIntPoint(0, 0), 3);
+		g->MoveTo(FIntPoint(2, 0));
+		EXPECT(manager.NumPendingLoads() == 25);
+
+		bGo = true;
+		Drain(manager);
+		EXPECT(numLoaded == 25);
+
+		// Moving back makes new cells at the old indices, only their own loads count
+		g->MoveTo(FIntPoint(0, 0));
+		Drain(manager);
+		EXPECT(numLoaded == 35);
+		for (auto& c : g->GetAllCells())
+			EXPECT(c->GetData() == Load(c->GetIndex()));
+	}
+
+	// Loads of released cells that no worker has started yet are skipped
+	void TestCancelledLoadsAreSkipped()
+	{
+		Manager manager;
+		std::atomic<bool> bGo{ false };
+		std::atomic<int> numOldLoads{ 0 };
+		int numLoaded = 0;
+		manager.SetLoader([&](FIntPoint index)
+		{
+			if (index.X < 50)
+				numOldLoads++;
+
+			while (!bGo)
+				std::this_thread::yield();
+			return Load(index);
+		},
+		[&](TCell<int64>& c)
+		{
+			numLoaded++;
+			EXPECT(c.GetIndex().X >= 50);
+		});
+
+		auto g = manager.CreateGrid(GridStorage::LINKED);
+		g->Init(FIntPoint(0, 0), 3);
+
+		// Workers take what they can and block, the rest of the loads wait in the queue
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		g->MoveTo(FIntPoint(100, 0));
+		int numStarted = numOldLoads;
+
+		bGo = true;
+		Drain(manager);
+		EXPECT(numOldLoads == numStarted);
+		EXPECT(numLoaded == 25);
+	}
+
+	// Cells revived from the cell cache keep their payload and are not loaded again
+	void TestCachedCellsAreNotLoaded()
+	{
+		Manager manager;
+		std::atomic<int> numLoads{ 0 };
+		manager.SetLoader([&](FIntPoint index) { numLoads++; return Load(index); });
+		manager.SetCellCache(1000);
+
+		auto g = manager.CreateGrid(GridStorage::LINKED);
+		g->Init(FIntPoint(0, 0), 2);
+		Drain(manager);
+
+		// Cells left while loading are not cached, so nothing is pending after coming back
+		g->MoveTo(FIntPoint(10, 0));
+		EXPECT(manager.NumPendingLoads() == 9);
+		g->MoveTo(FIntPoint(0, 0));
+		EXPECT(manager.NumPendingLoads() == 0);
+		for (auto& c : g->GetAllCells())
+			EXPECT(c->GetState() == CellState::READY && c->GetData() == Load(c->GetIndex()));
+		EXPECT(numLoads <= 18);
+	}
+
+	// Grids keep moving while loads finish, then the manager goes away with loads in flight
+	void TestWalks(bool bConcurrent)
+	{
+		Manager manager;
+		int numLoaded = 0;
+		manager.SetLoader([](FIntPoint index)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+			return Load(index);
+		},
+		[&](TCell<int64>& c)
+		{
+			numLoaded++;
+			EXPECT(c.GetData() == Load(c.GetIndex()));
+		});
+		manager.SetConcurrent(bConcurrent);
+
+		std::vector<Manager::GridPtr> grids;
+		std::vector<FIntPoint> positions;
+		for (int i = 0; i < 8; i++)
+		{
+			grids.push_back(manager.CreateGrid(i % 2 ? GridStorage::RING : GridStorage::LINKED));
+			positions.push_back(FIntPoint(i * 20, 0));
+			grids[i]->Init(positions[i], 4);
+		}
+
+		for (int tick = 0; tick < 60; tick++)
+		{
+			TArray<Manager::Move> moves;
+			for (size_t i = 0; i < grids.size(); i++)
+			{
+				positions[i] += FIntPoint(tick % 7 == 0 ? 9 : 1, int(i % 3) - 1);
+				moves.Push({ grids[i], positions[i] });
+			}
+
+			manager.MoveAll(moves);
+			manager.PumpLoads(tick % 2 ? 10 : -1);
+
+			for (auto& g : grids)
+				for (auto& c : g->GetAllCells())
+					if (c->GetState() == CellState::READY)
+						EXPECT(c->GetData() == Load(c->GetIndex()));
+		}
+
+		Drain(manager);
+		EXPECT(manager.NumPendingLoads() == 0);
+		EXPECT(numLoaded > 0);
+
+		for (auto& g : grids)
+			for (auto& c : g->GetAllCells())
+				EXPECT(c->GetState() == CellState::READY);
+
+		for (size_t i = 0; i < grids.size(); i++)
+			grids[i]->MoveTo(positions[i] + FIntPoint(1000, 0));
+	}
+}
+
+int main()
+{
+	TestPump();
+	TestReleasedWhileLoading();
+	TestCancelledLoadsAreSkipped();
+	TestCachedCellsAreNotLoaded();
+	TestWalks(false);
+	TestWalks(true);
+
+	return FinishTests("LoaderTests");
+}
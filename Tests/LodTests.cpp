@@ -0,0 +1,221 @@
+// Coarse LOD bands around grids, compared with the aggregates the band rectangles touch
+#include "DynamicGrid.h"
+#include "Test.h"
+
+#include <map>
+#include <tuple>
+
+using namespace serenity;
+
+namespace
+{
+	typedef TGridManager<int> Manager;
+	typedef TSharedPtr<TCell<int>, ESPMode::ThreadSafe> CellPtr;
+
+	// Full cells get 1, aggregates 10 + their level
+	class CountingSink : public TCountingSink<int>
+	{
+	public:
+		CountingSink()
+		{
+			onCreated = [](const CellPtr& cell) { cell->GetData() = 1; };
+			onLodCreated = [](const CellPtr& cell)
+			{
+				EXPECT(cell->GetLevel() >= 1);
+				cell->GetData() = 10 + cell->GetLevel();
+			};
+			onLodDeleted = [](int level, const int& data) { EXPECT(data == 10 + level); };
+		}
+	};
+
+	struct Rect
+	{
+		int x0, y0, x1, y1;
+
+		bool Contains(int x, int y) const { return x >= x0 && x <= x1 && y >= y0 && y <= y1; }
+		bool Contains(const Rect& o) const { return o.x0 >= x0 && o.x1 <= x1 && o.y0 >= y0 && o.y1 <= y1; }
+		bool Touches(const Rect& o) const { return x0 <= o.x1 && o.x0 <= x1 && y0 <= o.y1 && o.y0 <= y1; }
+	};
+
+	int FloorDiv(int a, int b)
+	{
+		return a >= 0 ? a / b : -((-a + b - 1) / b);
+	}
+
+	// A band of level l holds every 2^l aggregate touching its square that the square
+	// of the level below does not cover completely
+	void Check(const Manager& manager, const TArray<Manager::GridPtr>& grids, const CountingSink& sink)
+	{
+		std::map<std::tuple<int, int, int>, int> expected;
+
+		for (auto& g : grids)
+		{
+			if (!g->GetRoot())
+				continue;
+
+			auto& radii = g->GetLod();
+
+			// Only squares have bands
+			if (g->GetShape() != GridShape::SQUARE)
+			{
+				for (int level = 1; level <= radii.Num(); level++)
+					EXPECT(g->GetLodCells(level).Num() == 0);
+				continue;
+			}
+
+			FIntPoint center = g->GetRoot()->GetIndex();
+			int r = g->GetRadius();
+			Rect inner{ center.X - r + 1, center.Y - r + 1, center.X + r - 1, center.Y + r - 1 };
+
+			for (int level = 1; level <= radii.Num(); level++)
+			{
+				int side = 1 << level;
+				int br = radii[level - 1];
+				Rect band{ center.X - br + 1, center.Y - br + 1, center.X + br - 1, center.Y + br - 1 };
+
+				int num = 0;
+				for (int ax = FloorDiv(band.x0, side) - 1; ax <= FloorDiv(band.x1, side) + 1; ax++)
+					for (int ay = FloorDiv(band.y0, side) - 1; ay <= FloorDiv(band.y1, side) + 1; ay++)
+					{
+						Rect covered{ ax * side, ay * side, ax * side + side - 1, ay * side + side - 1 };
+						bool bInBand = covered.Touches(band) && !inner.Contains(covered);
+						EXPECT(bInBand == IsValid(g->FindLodCell(level, FIntPoint(ax * side, ay * side))));
+
+						if (bInBand)
+						{
+							expected[std::make_tuple(level, ax, ay)]++;
+							num++;
+						}
+					}
+
+				EXPECT(g->GetLodCells(level).Num() == num);
+
+				// Every full cell of the band is under the level below or an aggregate of this one
+				for (int x = band.x0; x <= band.x1; x++)
+					for (int y = band.y0; y <= band.y1; y++)
+						if (!inner.Contains(x, y))
+							EXPECT(IsValid(g->FindLodCell(level, FIntPoint(x, y))));
+
+				inner = band;
+			}
+		}
+
+		int64 numLive = 0;
+		for (int level = 1; level <= 3; level++)
+			numLive += manager.GetLodStats(level).numLive;
+
+		EXPECT(numLive == (int64)expected.size());
+		EXPECT(sink.numLodCreated - sink.numLodDeleted == (int)expected.size());
+
+		for (auto& pair : expected)
+		{
+			int level = std::get<0>(pair.first);
+			auto c = manager.FindLodCell(level, FIntPoint(std::get<1>(pair.first), std::get<2>(pair.first)));
+			EXPECT(IsValid(c));
+			if (!IsValid(c))
+				continue;
+
+			EXPECT((int)c->NumOwners().load() == pair.second);
+			EXPECT(c->GetLevel() == level);
+			EXPECT(c->GetData() == 10 + level);
+		}
+	}
+
+	// Walks of every storage and a disc, moved one by one, by MoveAll and concurrently,
+	// with resizes and band changes on the way
+	void TestWalks(int mode)
+	{
+		Manager manager;
+		manager.SetConcurrent(mode == 2);
+		CountingSink sink;
+
+		TArray<Manager::GridPtr> grids;
+		TArray<FIntPoint> positions;
+		for (int i = 0; i < 7; i++)
+		{
+			GridStorage storage = i % 3 == 2 ? GridStorage::CHUNKED : i % 2 ? GridStorage::RING : GridStorage::LINKED;
+			grids.Push(manager.CreateGrid(storage, i == 6 ? GridShape::DISC : GridShape::SQUARE));
+			positions.Push(FIntPoint(i * 7 - 20, -i * 3));
+
+			int r = 1 + i % 4;
+			if (i % 4 == 3)
+				grids[i]->SetLod({ r + 3 });
+			else
+				grids[i]->SetLod({ 2 * r + 1, 4 * r + 2, 9 * r });
+			grids[i]->Init(positions[i], r, sink);
+		}
+
+		Check(manager, grids, sink);
+
+		FTestRandom random(11 + mode);
+
+		for (int step = 0; step < 300; step++)
+		{
+			TArray<Manager::Move> moves;
+			for (int i = 0; i < grids.Num(); i++)
+			{
+				int k = random.Next() % 20;
+				positions[i] += k < 10 ? FIntPoint(1, 0) : k < 13 ? FIntPoint(-1, 1) : k < 16 ? FIntPoint(0, -2) : k < 19 ? FIntPoint(0, 0) : FIntPoint(-37, 21);
+
+				if (mode == 0)
+					grids[i]->MoveTo(positions[i], sink);
+				else
+					moves.Push({ grids[i], positions[i] });
+			}
+
+			if (mode)
+				manager.MoveAll(moves, sink);
+
+			if (step % 40 == 7)
+				grids[step % 7]->Resize(1 + step % 5, sink);
+
+			// New bands take effect with the next change of the grid
+			if (step % 60 == 13)
+			{
+				auto& g = grids[step % 7];
+				if (step % 120 == 13)
+					g->SetLod({});
+				else
+					g->SetLod({ 3, 11 });
+				g->Resize(g->GetRadius(), sink);
+			}
+
+			Check(manager, grids, sink);
+		}
+
+		for (int i = 0; i < 3; i++)
+			manager.DestroyGrid(grids[i], sink);
+		for (auto& g : grids)
+			g->Clear(sink);
+
+		EXPECT(sink.numCreated == sink.numDeleted);
+		EXPECT(sink.numLodCreated == sink.numLodDeleted);
+		for (int level = 1; level <= 3; level++)
+			EXPECT(manager.GetLodStats(level).numLive == 0);
+		EXPECT(manager.GetCellStats().numLive == 0);
+	}
+
+	void TestDelivered()
+	{
+		Manager manager;
+		auto g = manager.CreateGrid();
+		g->SetLod({ 4 });
+
+		// 4x4 aggregates of 2x2 cells touch the 7x7 band, the one inside the 3x3 grid is left out
+		auto d = g->Init(FIntPoint(0, 0), 2);
+		EXPECT(d.created.Num() == 9);
+		EXPECT(d.lodCreated.Num() == 15);
+
+		auto cleared = g->Clear();
+		EXPECT(cleared.lodDeleted.Num() == 15);
+	}
+}
+
+int main()
+{
+	for (int mode = 0; mode < 3; mode++)
+		TestWalks(mode);
+	TestDelivered();
+
+	return FinishTests("LodTests");
+}
@@ -0,0 +1,143 @@
+// Cell counters and latency histograms of grids and their manager
+#include "DynamicGrid.h"
+#include "Test.h"
+
+using namespace serenity;
+
+namespace
+{
+	typedef TGridManager<int> Manager;
+
+	// Bucket 0 takes [0, 2) ns, bucket i above it [2^i, 2^(i+1)) ns
+	void TestHistogramBuckets()
+	{
+		LatencyHistogram h;
+		for (int64 ns : { 0, 1, 2, 3, 4, 1023, 1024 })
+			h.Add(ns);
+
+		EXPECT(h.buckets[0] == 2);
+		EXPECT(h.buckets[1] == 2);
+		EXPECT(h.buckets[2] == 1);
+		EXPECT(h.buckets[9] == 1);
+		EXPECT(h.buckets[10] == 1);
+		EXPECT(h.count == 7);
+		EXPECT(h.totalNs == 2057);
+		EXPECT(h.maxNs == 1024);
+
+		// Anything past the last edge stays in the last bucket
+		h.Add(int64(1) << 50);
+		EXPECT(h.buckets[LatencyHistogram::NumBuckets - 1] == 1);
+
+		LatencyHistogram other;
+		other.Add(5);
+		other.Append(h);
+		EXPECT(other.count == 9);
+		EXPECT(other.buckets[2] == 2);
+		EXPECT(other.maxNs == int64(1) << 50);
+	}
+
+	// Percentiles are upper bucket edges, capped by the slowest call
+	void TestPercentiles()
+	{
+		LatencyHistogram h;
+		EXPECT(h.PercentileNs(0.5) == 0);
+		EXPECT(h.MeanNs() == 0.0);
+
+		for (int i = 0; i < 90; i++)
+			h.Add(100);
+		for (int i = 0; i < 10; i++)
+			h.Add(5000);
+
+		EXPECT(h.PercentileNs(0.5) == 128);
+		EXPECT(h.PercentileNs(0.9) == 128);
+		EXPECT(h.PercentileNs(0.99) == 5000);
+		EXPECT(h.MeanNs() == 590.0);
+	}
+
+	void TestGridCounters()
+	{
+		Manager manager;
+		auto a = manager.CreateGrid(GridStorage::LINKED);
+		auto b = manager.CreateGrid(GridStorage::RING);
+
+		// 5x5 squares overlapping by 3 columns
+		a->Init(FIntPoint(0, 0), 3);
+		b->Init(FIntPoint(2, 0), 3);
+
+		auto ma = a->GetMetrics();
+		auto mb = b->GetMetrics();
+		EXPECT(ma.numCreated == 25 && ma.numShared == 0);
+		EXPECT(mb.numCreated == 10 && mb.numShared == 15);
+
+		// Resize inside Init is part of the Init call
+		EXPECT(ma.latency[(int)GridOp::INIT].count == 1);
+		EXPECT(ma.latency[(int)GridOp::RESIZE].count == 0);
+
+		for (int i = 0; i < 4; i++)
+			b->FindCellByIndex(FIntPoint(i, 0));
+		EXPECT(b->GetMetrics().numLookups == 4);
+
+		// b is the last owner of the cells it has to itself only
+		b->MoveTo(FIntPoint(3, 0));
+		b->Clear();
+		mb = b->GetMetrics();
+		EXPECT(mb.numCreated == 15);
+		EXPECT(mb.numReleased == 15);
+		EXPECT(mb.latency[(int)GridOp::MOVE].count == 1);
+		EXPECT(mb.latency[(int)GridOp::CLEAR].count == 1);
+
+		// Destroyed grids stay in the total of the manager
+		manager.DestroyGrid(b);
+		TArray<Manager::Move> moves;
+		moves.Push({ a, FIntPoint(1, 1) });
+		manager.MoveAll(moves);
+
+		auto total = manager.GetMetrics();
+		EXPECT(total.numCreated == 25 + 15 + 9);
+		EXPECT(total.numLookups == 4);
+		EXPECT(total.latency[(int)GridOp::INIT].count == 2);
+		EXPECT(total.latency[(int)GridOp::MOVE_ALL].count == 1);
+
+		manager.ResetMetrics();
+		total = manager.GetMetrics();
+		EXPECT(total.numCreated == 0 && total.numLookups == 0);
+		EXPECT(total.latency[(int)GridOp::INIT].count == 0);
+		EXPECT(a->GetMetrics().numCreated == 0);
+	}
+
+	// Concurrent MoveAll groups its plans, pairs found in one set are not checked again
+	void TestGroupedPlans()
+	{
+		Manager manager;
+		TArray<Manager::Move> moves;
+		for (int x : { 0, 2, 1000 })
+		{
+			auto g = manager.CreateGrid(GridStorage::LINKED);
+			g->Init(FIntPoint(x, 0), 3);
+			moves.Push({ g, FIntPoint(x + 1, 0) });
+		}
+
+		manager.MoveAll(moves);
+		EXPECT(manager.GetMetrics().numGroupedPlans == 0);
+
+		for (auto& m : moves)
+			m.target.Y++;
+
+		manager.SetConcurrent(true);
+		manager.MoveAll(moves);
+		auto total = manager.GetMetrics();
+		EXPECT(total.numGroupedPlans == 3);
+		EXPECT(total.numOverlapChecks == 1);
+		EXPECT(total.AverageOverlapChecks() == 1.0 / 3);
+	}
+}
+
+int main()
+{
+	TestHistogramBuckets();
+	TestPercentiles();
+	TestGridCounters();
+	TestGroupedPlans();
+
+	return FinishTests("MetricsTests");
+}
@@ -0,0 +1,167 @@
+// Batched moves compared with the same moves done one grid at a time
+#include "DynamicGrid.h"
+#include "Test.h"
+
+#include <atomic>
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace serenity;
+
+namespace
+{
+	typedef std::map<std::pair<int, int>, size_t> Owners;
+
+	// Grids of one manager and where they should be
+	struct World
+	{
+		World()
+		{
+			manager.SetPayloadHooks([this](Cell&) { nNumLive++; }, [this](Cell&) { nNumLive--; });
+		}
+
+		GridManager manager;
+		std::vector<Grid::ptr> grids;
+		std::vector<FIntPoint> positions;
+		// Payload hooks run on the workers of a concurrent MoveAll
+		std::atomic<int64> nNumLive{ 0 };
+	};
+
+	// Owners of every covered cell, checked against the manager on the way
+	Owners Snapshot(World& world)
+	{
+		Owners owners;
+		for (size_t i = 0; i < world.grids.size(); i++)
+		{
+			int r = world.grids[i]->GetRadius() - 1;
+			for (int x = -r; x <= r; x++)
+				for (int y = -r; y <= r; y++)
+				{
+					auto index = world.positions[i] + FIntPoint(x, y);
+					auto c = world.grids[i]->FindCellByIndex(index);
+					EXPECT(IsValid(c) && c->GetIndex() == index);
+					owners[{ index.X, index.Y }]++;
+				}
+		}
+
+		for (auto& pair : owners)
+		{
+			auto c = world.manager.FindCell(pair.first.first, pair.first.second);
+			EXPECT(IsValid(c) && (size_t)c->NumOwners() == pair.second);
+		}
+
+		EXPECT(world.nNumLive == (int64)owners.size());
+		return owners;
+	}
+
+	void AddGrid(World& world, GridStorage storage, FIntPoint position, int radius)
+	{
+		world.grids.push_back(world.manager.CreateGrid(storage));
+		world.grids.back()->Init(position, radius);
+		world.positions.push_back(position);
+	}
+
+	// Mostly the same unit step for every grid, so they keep passing cells to each other
+	void TestMatchesMoveTo(GridStorage storage, uint32 seed)
+	{
+		FTestRandom random(seed);
+
+		World batched, single;
+		int numGrids = random.Range(2, 13);
+		for (int i = 0; i < numGrids; i++)
+		{
+			int radius = random.Range(1, 5);
+			FIntPoint position(random.Range(0, 19), random.Range(0, 19));
+			AddGrid(batched, storage, position, radius);
+			AddGrid(single, storage, position, radius);
+		}
+
+		for (int tick = 0; tick < 20; tick++)
+		{
+			TArray<GridManager::Move> moves;
+			FIntPoint common(random.Range(-1, 1), random.Range(-1, 1));
+			for (int i = 0; i < numGrids; i++)
+			{
+				FIntPoint step = random.Next() % 3 ? common : FIntPoint(random.Range(-1, 1), random.Range(-1, 1));
+				if (random.Next() % 15 == 0)
+					step = FIntPoint(random.Range(-15, 14), random.Range(-15, 14));
+
+				batched.positions[i] += step;
+				single.positions[i] += step;
+				moves.Push({ batched.grids[i], batched.positions[i] });
+				single.grids[i]->MoveTo(single.positions[i]);
+			}
+
+			// A cell passed between grids is neither created nor deleted
+			auto delivered = batched.manager.MoveAll(moves);
+			std::map<std::pair<int, int>, int> created;
+			for (auto& c : delivered.created)
+			{
+				auto key = std::make_pair(c->GetIndex().X, c->GetIndex().Y);
+				EXPECT(IsValid(c) && created[key]++ == 0);
+			}
+
+			EXPECT(Snapshot(batched) == Snapshot(single));
+		}
+	}
+
+	// Many grids spread wide enough to fall into several groups moved on workers
+	void TestConcurrentMatchesSerial(GridStorage storage, uint32 seed)
+	{
+		FTestRandom random(seed);
+
+		World concurrent, serial;
+		concurrent.manager.SetConcurrent(true);
+
+		int numGrids = random.Range(20, 219);
+		int spread = random.Range(20, 419);
+		for (int i = 0; i < numGrids; i++)
+		{
+			int radius = random.Range(1, 6);
+			FIntPoint position(random.Range(0, spread - 1), random.Range(0, spread - 1));
+			AddGrid(concurrent, storage, position, radius);
+			AddGrid(serial, storage, position, radius);
+		}
+
+		for (int tick = 0; tick < 15; tick++)
+		{
+			TArray<GridManager::Move> concurrentMoves, serialMoves;
+			for (int i = 0; i < numGrids; i++)
+			{
+				FIntPoint step(random.Range(-1, 1), random.Range(-1, 1));
+				if (random.Next() % 20 == 0)
+					step = FIntPoint(random.Range(-30, 29), random.Range(-30, 29));
+
+				concurrent.positions[i] += step;
+				serial.positions[i] += step;
+				concurrentMoves.Push({ concurrent.grids[i], concurrent.positions[i] });
+				serialMoves.Push({ serial.grids[i], serial.positions[i] });
+			}
+
+			auto a = concurrent.manager.MoveAll(concurrentMoves);
+			auto b = serial.manager.MoveAll(serialMoves);
+			EXPECT(a.created.Num() == b.created.Num());
+			EXPECT(a.deleted.Num() == b.deleted.Num());
+			EXPECT(Snapshot(concurrent) == Snapshot(serial));
+		}
+
+		for (auto& g : concurrent.grids)
+			g->Clear();
+		EXPECT(concurrent.nNumLive == 0);
+	}
+}
+
+int main()
+{
+	for (uint32 seed = 1; seed <= 20; seed++)
+	{
+		TestMatchesMoveTo(GridStorage::LINKED, seed);
+		TestMatchesMoveTo(GridStorage::RING, seed);
+	}
+
+	for (uint32 seed = 1; seed <= 6; seed++)
+		TestConcurrentMatchesSerial(seed % 2 ? GridStorage::RING : GridStorage::LINKED, seed);
+
+	return FinishTests("MoveAllTests");
+}
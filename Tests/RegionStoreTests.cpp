@@ -0,0 +1,162 @@
+// Cell records kept in memory-mapped region files across stores and payload flavours
+#include "RegionStore.h"
+#include "Test.h"
+
+#include <filesystem>
+
+using namespace serenity;
+
+namespace
+{
+	struct Tile
+	{
+		int32 x, y;
+		int32 visits;
+		float height;
+	};
+
+	// Pointer payloads point right into the mapped pages
+	void TestPointerPayloads(const FString& directory)
+	{
+		TRegionStore<Tile> store(directory);
+		TGridManager<void*> manager;
+		store.Attach(manager);
+
+		auto visit = [](const Delivered& d)
+		{
+			for (auto& c : d.created)
+			{
+				auto tile = (Tile*)c->GetData();
+				EXPECT(tile && tile->visits == 0);
+				if (!tile)
+					continue;
+
+				tile->x = c->GetIndex().X;
+				tile->y = c->GetIndex().Y;
+				tile->visits++;
+			}
+		};
+
+		auto g = manager.CreateGrid(GridStorage::RING);
+		visit(g->Init(FIntPoint(0, 0), 5));
+
+		// A diagonal walk through several regions never meets a visited cell
+		for (int i = 1; i <= 40; i++)
+		{
+			auto d = g->MoveTo(FIntPoint(i, -i));
+			EXPECT(d.deleted.Num() == 0);
+			visit(d);
+		}
+
+		// Only regions under the grid stay mapped
+		store.Flush();
+		EXPECT(store.NumMapped() <= 4);
+
+		g->MoveTo(FIntPoint(0, 0));
+		for (auto& c : g->GetAllCells())
+		{
+			auto tile = (Tile*)c->GetData();
+			EXPECT(tile->x == c->GetIndex().X && tile->y == c->GetIndex().Y && tile->visits == 1);
+		}
+
+		g->Clear();
+		store.Flush();
+		EXPECT(store.NumMapped() == 0);
+	}
+
+	// Record payloads are copied in on create and out on release, concurrent moves included
+	void TestRecordPayloads(const FString& directory)
+	{
+		{
+			TRegionStore<Tile> store(directory);
+			TGridManager<Tile> manager;
+			store.Attach(manager);
+			manager.SetConcurrent(true);
+
+			auto g = manager.CreateGrid(GridStorage::CHUNKED);
+			g->Init(FIntPoint(20, -20), 4);
+			for (auto& c : g->GetAllCells())
+			{
+				EXPECT(c->GetData().visits == 1 && c->GetData().x == c->GetIndex().X);
+				c->GetData().visits = 7;
+			}
+
+			g->Clear();
+			store.Flush();
+		}
+
+		// A new store reads what the last one wrote
+		TRegionStore<Tile> store(directory);
+		Tile* tile = store.Pin(FIntPoint(20, -20));
+		EXPECT(tile && tile->visits == 7);
+		EXPECT(store.Find(FIntPoint(20, -20)) == tile);
+		store.Unpin(FIntPoint(20, -20), false);
+	}
+
+	// Hooks set before Attach keep running and see the record in the payload.
+	// A pointer payload they replaced is not cleared on release
+	void TestChainedHooks(const FString& directory)
+	{
+		TRegionStore<Tile> store(directory);
+		TGridManager<void*> manager;
+
+		Tile other = {};
+		int numCreated = 0;
+		int numReleased = 0;
+		manager.SetPayloadHooks(
+			[&](Cell& c)
+			{
+				auto tile = (Tile*)c.GetData();
+				EXPECT(tile && tile->visits == 1);
+				numCreated++;
+			},
+			[&](Cell& c)
+			{
+				EXPECT(c.GetData() == store.Find(c.GetIndex()));
+				if (c.GetIndex().X == 0)
+					c.GetData() = &other;
+				numReleased++;
+			});
+		store.Attach(manager);
+
+		auto g = manager.CreateGrid(GridStorage::LINKED);
+		g->Init(FIntPoint(0, 0), 3);
+		EXPECT(numCreated == 25);
+
+		auto cleared = g->Clear();
+		EXPECT(numReleased == 25);
+		EXPECT(cleared.deleted.Num() == 25);
+
+		int numReplaced = 0;
+		for (void* data : cleared.deleted)
+		{
+			EXPECT(data == nullptr || data == &other);
+			numReplaced += data == &other;
+		}
+		EXPECT(numReplaced == 5);
+	}
+
+	// Files of another record type are left alone
+	void TestOtherFormat(const FString& directory)
+	{
+		TRegionStore<int64> store(directory);
+		EXPECT(store.Pin(FIntPoint(20, -20)) == nullptr);
+		store.Unpin(FIntPoint(20, -20), false);
+	}
+}
+
+int main()
+{
+	auto path = std::filesystem::temp_directory_path() / "DynamicGridsRegionStoreTests";
+	std::filesystem::remove_all(path);
+	FString directory(path.string().c_str());
+
+	TestPointerPayloads(directory);
+	TestRecordPayloads(directory);
+	TestChainedHooks(directory);
+	TestOtherFormat(directory);
+
+	std::filesystem::remove_all(path);
+
+	return FinishTests("RegionStoreTests");
+}
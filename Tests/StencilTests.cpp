@@ -0,0 +1,173 @@
+// Stencil passes over payloads gathered from grids, compared with a naive pass over a map
+#include "GridStencil.h"
+#include "Test.h"
+
+#include <map>
+#include <utility>
+
+using namespace serenity;
+
+namespace
+{
+	template<typename V>
+	using Values = std::map<std::pair<int, int>, V>;
+
+	// Reads the 3x3 neighbourhood of every cell from the map, kernel(n) gets n[dy + 1][dx + 1]
+	template<typename V, typename K>
+	Values<V> NaivePass(const Values<V>& values, V outside, K&& kernel)
+	{
+		Values<V> out;
+		for (auto& pair : values)
+		{
+			V n[3][3];
+			for (int dy = -1; dy <= 1; dy++)
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					auto found = values.find({ pair.first.first + dx, pair.first.second + dy });
+					n[dy + 1][dx + 1] = found == values.end() ? outside : found->second;
+				}
+
+			out[pair.first] = kernel(n);
+		}
+		return out;
+	}
+
+	template<typename V>
+	int CountMismatches(const TGridStencil<V, V>& stencil, const Values<V>& expected)
+	{
+		int num = 0;
+		for (auto& pair : expected)
+			if (stencil.Get(FIntPoint(pair.first.first, pair.first.second)) != pair.second)
+				num++;
+		return num;
+	}
+
+	// Overlapping squares of both storages and a disc, payloads are small integers,
+	// so every pass is exact for float too
+	template<typename V>
+	void TestPasses(uint32 seed)
+	{
+		typedef TGridManager<V> Manager;
+		typedef TGridStencil<V, V> Stencil;
+
+		Manager manager;
+		TArray<typename Manager::GridPtr> grids;
+		for (int i = 0; i < 5; i++)
+		{
+			grids.Push(manager.CreateGrid(i % 2 ? GridStorage::RING : GridStorage::LINKED, i == 4 ? GridShape::DISC : GridShape::SQUARE));
+			grids[i]->Init(FIntPoint(i * 11 - 30, i * 7 - 17), 3 + 2 * i);
+		}
+
+		FTestRandom random(seed);
+
+		Values<V> values;
+		manager.ForEachCell([&](const typename Manager::CellPtr& c)
+		{
+			c->GetData() = (V)(random.Next() % 100);
+			values[{ c->GetIndex().X, c->GetIndex().Y }] = c->GetData();
+		});
+
+		const V outside = (V)-3;
+
+		Stencil stencil;
+		stencil.SetOutside(outside);
+		stencil.Gather(manager, [](const TCell<V>& c) { return c.GetData(); });
+		EXPECT(stencil.NumCells() == (int)values.size());
+		EXPECT(CountMismatches(stencil, values) == 0);
+
+		V weights[9] = { (V)1, (V)2, (V)1, (V)2, (V)4, (V)2, (V)1, (V)2, (V)1 };
+		if (!std::is_integral<V>::value)
+			for (auto& w : weights)
+				w = w / (V)16;
+
+		for (int pass = 0; pass < 12; pass++)
+		{
+			if (pass % 3 == 0)
+			{
+				stencil.Convolve(weights);
+				values = NaivePass<V>(values, outside, [&](V (&n)[3][3])
+				{
+					V sum = V();
+					for (int dy = 0; dy < 3; dy++)
+						for (int dx = 0; dx < 3; dx++)
+							sum = sum + weights[dy * 3 + dx] * n[dy][dx];
+					return sum;
+				});
+			}
+			else if (pass % 3 == 1)
+			{
+				stencil.Spread((V)3);
+				values = NaivePass<V>(values, outside, [&](V (&n)[3][3])
+				{
+					V best = n[0][0];
+					for (int dy = 0; dy < 3; dy++)
+						for (int dx = 0; dx < 3; dx++)
+							if (dx != 1 || dy != 1)
+								best = FMath::Max(best, n[dy][dx]);
+					return FMath::Max(n[1][1], best - (V)3);
+				});
+			}
+			else
+			{
+				stencil.Apply([](const typename Stencil::Window& n) { return n(1, 0) - n(-1, 0) + n(0, 1) * (V)2 - n(1, -1); });
+				values = NaivePass<V>(values, outside, [&](V (&n)[3][3]) { return n[1][2] - n[1][0] + n[2][1] * (V)2 - n[0][2]; });
+
+				// Keeps the values small, and goes through Set
+				for (auto& pair : values)
+				{
+					pair.second = (V)((int)pair.second % 1000);
+					EXPECT(stencil.Set(FIntPoint(pair.first.first, pair.first.second), pair.second));
+				}
+			}
+
+			EXPECT(CountMismatches(stencil, values) == 0);
+			EXPECT(stencil.Get(FIntPoint(100000, 5)) == outside);
+		}
+
+		EXPECT(!stencil.Set(FIntPoint(100000, 5), (V)1));
+
+		// Results go back into the payloads
+		stencil.Scatter(manager, [](TCell<V>& c, const V& value) { c.GetData() = value; });
+
+		int numWrong = 0;
+		manager.ForEachCell([&](const typename Manager::CellPtr& c)
+		{
+			if (c->GetData() != values[{ c->GetIndex().X, c->GetIndex().Y }])
+				numWrong++;
+		});
+		EXPECT(numWrong == 0);
+
+		for (auto& g : grids)
+			g->Clear();
+	}
+
+	// A cell released after the gather is skipped by the scatter
+	void TestScatterSkipsReleased()
+	{
+		TGridManager<int32> manager;
+		auto g = manager.CreateGrid(GridStorage::LINKED);
+		g->Init(FIntPoint(0, 0), 3);
+
+		TGridStencil<int32, int32> stencil;
+		stencil.Gather(manager, [](const TCell<int32>&) { return 1; });
+		EXPECT(stencil.NumCells() == 25);
+
+		g->MoveTo(FIntPoint(1, 0));
+
+		int numWritten = 0;
+		stencil.Scatter(manager, [&](TCell<int32>& c, const int32&) { numWritten++; EXPECT(c.GetIndex().X <= 2); });
+		EXPECT(numWritten == 20);
+
+		g->Clear();
+	}
+}
+
+int main()
+{
+	TestPasses<float>(3);
+	TestPasses<int32>(5);
+	TestPasses<double>(7);
+	TestScatterSkipsReleased();
+
+	return FinishTests("StencilTests");
+}
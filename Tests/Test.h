@@ -0,0 +1,114 @@
+#pragma once
+// Checks shared by the behaviour tests. A failed check is printed and counted,
+// and the test returns the count, so ctest reports it as failed
+#include "DynamicGrid.h"
+
+#include <cstdio>
+
+namespace serenity
+{
+	inline int& NumFailedChecks()
+	{
+		static int num = 0;
+		return num;
+	}
+
+	inline int FinishTests(const char* name)
+	{
+		std::printf("%s: %d failed checks\n", name, NumFailedChecks());
+		return NumFailedChecks() ? 1 : 0;
+	}
+
+	// Small LCG, so every run and platform walks the same random steps
+	struct FTestRandom
+	{
+		explicit FTestRandom(uint32 seed) : nSeed(seed) {}
+
+		// Returns a value in [0, 32767]
+		int Next()
+		{
+			nSeed = nSeed * 1103515245 + 12345;
+			return int((nSeed >> 16) & 0x7fff);
+		}
+
+		// Returns a value in [min, max]
+		int Range(int min, int max)
+		{
+			return min + Next() % (max - min + 1);
+		}
+
+		uint32 nSeed;
+	};
+
+	// Counts what grids report to it. Payloads are set and checked through the
+	// optional callbacks, so tests only write what their payloads mean
+	template<typename T>
+	class TCountingSink : public TGridSink<T>
+	{
+	public:
+		typedef TSharedPtr<TCell<T>, ESPMode::ThreadSafe> CellPtr;
+
+		int numCreated = 0;
+		int numDeleted = 0;
+		int numPromoted = 0;
+		int numRevived = 0;
+		int numLodCreated = 0;
+		int numLodDeleted = 0;
+
+		TFunction<void(const CellPtr&)> onCreated;
+		TFunction<void(const T&)> onDeleted;
+		TFunction<void(const CellPtr&)> onRevived;
+		TFunction<void(const CellPtr&)> onLodCreated;
+		TFunction<void(int, const T&)> onLodDeleted;
+
+		void OnCreated(const CellPtr& cell) override
+		{
+			numCreated++;
+			if (onCreated)
+				onCreated(cell);
+		}
+
+		void OnDeleted(T&& data) override
+		{
+			numDeleted++;
+			if (onDeleted)
+				onDeleted(data);
+		}
+
+		void OnPromoted(const CellPtr& /*cell*/) override
+		{
+			numPromoted++;
+		}
+
+		void OnRevived(const CellPtr& cell) override
+		{
+			numRevived++;
+			if (onRevived)
+				onRevived(cell);
+		}
+
+		void OnLodCreated(const CellPtr& cell) override
+		{
+			numLodCreated++;
+			if (onLodCreated)
+				onLodCreated(cell);
+		}
+
+		void OnLodDeleted(int level, T&& data) override
+		{
+			numLodDeleted++;
+			if (onLodDeleted)
+				onLodDeleted(level, data);
+		}
+	};
+}
+
+#define EXPECT(expr) \
+	do \
+	{ \
+		if (!(expr)) \
+		{ \
+			serenity::NumFailedChecks()++; \
+			std::printf("%s:%d: EXPECT(%s) failed\n", __FILE__, __LINE__, #expr); \
+		} \
+	} while (0)
@@ -0,0 +1,162 @@
+// Volume grids sharing cells, checked against the boxes the grids cover
+#include "VolumeGrid.h"
+#include "Test.h"
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+using namespace serenity;
+
+namespace
+{
+	typedef TVolumeGridManager<int> Manager;
+	typedef TSharedPtr<TVolumeCell<int>> CellPtr;
+	typedef std::map<std::tuple<int, int, int>, int> Owners;
+
+	class CountingSink : public TVolumeSink<int>
+	{
+	public:
+		int numCreated = 0;
+		int numDeleted = 0;
+
+		void OnCreated(const CellPtr& cell) override
+		{
+			numCreated++;
+			cell->GetData() = 1;
+		}
+
+		void OnDeleted(int&& data) override
+		{
+			numDeleted++;
+			EXPECT(data == 1);
+		}
+	};
+
+	struct Box
+	{
+		FIntVector center;
+		int radius;
+		int height;		// 0 makes a cube
+	};
+
+	Owners ExpectedOwners(const std::vector<Box>& boxes)
+	{
+		Owners owners;
+		for (auto& box : boxes)
+		{
+			int r = box.radius - 1;
+			int h = (box.height ? box.height : box.radius) - 1;
+			for (int x = -r; x <= r; x++)
+				for (int y = -r; y <= r; y++)
+					for (int z = -h; z <= h; z++)
+						owners[std::make_tuple(box.center.X + x, box.center.Y + y, box.center.Z + z)]++;
+		}
+		return owners;
+	}
+
+	void CheckOwners(const Manager& manager, const Owners& expected)
+	{
+		for (auto& pair : expected)
+		{
+			auto c = manager.FindCell(FIntVector(std::get<0>(pair.first), std::get<1>(pair.first), std::get<2>(pair.first)));
+			EXPECT(IsValid(c) && c->NumOwners() == pair.second);
+		}
+
+		EXPECT(manager.GetCellStats().numLive == (int64)expected.size());
+	}
+
+	void TestNeighbours()
+	{
+		Manager manager;
+		CountingSink sink;
+
+		auto g = manager.CreateGrid();
+		g->Init(FIntVector(0, 0, 0), 2, 0, sink);
+		EXPECT(sink.numCreated == 27);
+
+		// The center cell sees all 26, a cell on the top face only 17
+		auto c = manager.FindCell(FIntVector(0, 0, 0));
+		int num = 0;
+		c->ForEachNeighbour([&](const CellPtr&) { num++; });
+		EXPECT(num == 26);
+
+		EXPECT(IsValid(c->GetN(Direction::TOP)));
+		EXPECT(c->GetN(Direction::TOP)->GetIndex() == FIntVector(0, 0, 1));
+		EXPECT(IsValid(c->GetN(Direction::FRONT_LEFT)));
+
+		auto top = manager.FindCell(FIntVector(0, 0, 1));
+		EXPECT(!IsValid(top->GetN(Direction::TOP)));
+		num = 0;
+		top->ForEachNeighbour([&](const CellPtr&) { num++; });
+		EXPECT(num == 17);
+
+		// One layer up: a new 3x3 layer on top, the bottom one goes
+		g->MoveTo(FIntVector(0, 0, 1), sink);
+		EXPECT(sink.numCreated == 36);
+		EXPECT(sink.numDeleted == 9);
+
+		manager.DestroyGrid(g, sink);
+		EXPECT(manager.GetCellStats().numLive == 0);
+	}
+
+	// Random walks, jumps and resizes of several boxes
+	void TestWalks()
+	{
+		Manager manager;
+		CountingSink sink;
+
+		std::vector<Manager::GridPtr> grids;
+		std::vector<Box> boxes;
+		for (int i = 0; i < 5; i++)
+		{
+			boxes.push_back({ FIntVector(i * 3, -i, i), 1 + i % 4, i % 2 ? 2 : 0 });
+			grids.push_back(manager.CreateGrid());
+			grids[i]->Init(boxes[i].center, boxes[i].radius, boxes[i].height, sink);
+		}
+
+		FTestRandom random(9);
+
+		for (int step = 0; step < 400; step++)
+		{
+			for (size_t i = 0; i < grids.size(); i++)
+			{
+				int k = random.Next() % 12;
+				FIntVector d(k == 0 ? 1 : k == 1 ? -1 : 0, k == 2 ? 1 : k == 3 ? -1 : 0, k == 4 ? 1 : k == 5 ? -1 : 0);
+				if (k == 6)
+					d = FIntVector(20, -3, 9);
+
+				boxes[i].center = boxes[i].center + d;
+				grids[i]->MoveTo(boxes[i].center, sink);
+
+				if (k == 7)
+				{
+					boxes[i].radius = random.Range(1, 5);
+					boxes[i].height = random.Range(0, 2);
+					grids[i]->Resize(boxes[i].radius, boxes[i].height, sink);
+				}
+			}
+
+			auto expected = ExpectedOwners(boxes);
+			CheckOwners(manager, expected);
+			EXPECT(sink.numCreated - sink.numDeleted == (int)expected.size());
+		}
+
+		for (auto& g : grids)
+			manager.DestroyGrid(g, sink);
+
+		// Every brick went back to the free list
+		auto stats = manager.GetCellStats();
+		EXPECT(stats.numLive == 0);
+		EXPECT(stats.numSlabs == stats.numFreeSlabs);
+		EXPECT(sink.numCreated == sink.numDeleted);
+	}
+}
+
+int main()
+{
+	TestNeighbours();
+	TestWalks();
+
+	return FinishTests("VolumeGridTests");
+}
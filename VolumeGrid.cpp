@@ -0,0 +1,11 @@
+#include "VolumeGrid.h"
+
+namespace serenity
+{
+	// Untyped flavour is compiled here, so every build checks the templates
+	template class TVolumeCell<void*>;
+	template class TVolumePool<void*>;
+	template class TVolumeDelivered<void*>;
+	template class TVolumeGrid<void*>;
+	template class TVolumeGridManager<void*>;
+}
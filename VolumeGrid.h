@@ -0,0 +1,256 @@
+#pragma once
+#include "DynamicGrid.h"
+
+namespace serenity
+{
+	template<typename T> class TVolumePool;
+	template<typename T> class TVolumeGrid;
+	template<typename T> class TVolumeGridManager;
+
+	// Cell of a 3D world. Neighbours are the 26 cells around it, they are found
+	// by index through the pool, so the cell stores no links
+	template<typename T>
+	class TVolumeCell
+	{
+	public:
+		typedef TSharedPtr<TVolumeCell> ptr;
+
+		FIntVector GetIndex() const;
+
+		T& GetData();
+
+		int NumOwners() const;
+
+		bool IsValid() const;
+
+		// Neighbour on a planar direction or TOP/BOTTOM, null if it is not loaded
+		const ptr& GetN(Direction dir) const;
+
+		// Neighbour at an offset of -1..1 on each axis
+		const ptr& GetNeighbour(FIntVector offset) const;
+
+		// Calls f with every loaded neighbour of the 26, a brick is looked up once for all of its cells
+		template<typename F>
+		void ForEachNeighbour(F&& f) const;
+
+	protected:
+		friend class TVolumePool<T>;
+		friend class TVolumeGrid<T>;
+
+		bool bIsValid = false;
+		int nNumOwners = 0;
+
+		T Data = T();
+
+		FIntVector index;
+
+		TVolumePool<T>* pool = nullptr;
+	};
+
+	// Allocates volume cells in bricks of BrickSide^3 cells, x runs fastest inside a brick.
+	// A column streams in brick by brick, and empty bricks are reused by other places
+	template<typename T>
+	class TVolumePool
+	{
+	public:
+		typedef TVolumeCell<T> Cell;
+		typedef TSharedPtr<Cell> CellPtr;
+
+		static const int BrickShift = 3;
+		static const int BrickSide = 1 << BrickShift;
+		static const int BrickSize = BrickSide * BrickSide * BrickSide;
+
+		// Returns a fresh cell with one owner, there must be no live cell at the index
+		CellPtr Acquire(FIntVector index);
+
+		// Resets the cell, its slot becomes free. Returns the payload it had
+		T Release(CellPtr c);
+
+		// Returns the live cell at the index
+		const CellPtr& Find(FIntVector index) const;
+
+		int NumBricks() const;
+		int NumFreeBricks() const;
+		CellStats GetStats() const;
+
+		static FIntVector GetBrick(FIntVector index);
+
+		// Run on the payload right after a cell is created and right before it is released
+		TFunction<void(Cell&)> OnCreate;
+		TFunction<void(Cell&)> OnRelease;
+
+	protected:
+		friend class TVolumeCell<T>;
+
+		struct Brick
+		{
+			Cell cells[BrickSize];
+		};
+
+		struct BrickEntry
+		{
+			TSharedPtr<Brick> data;
+
+			// Handed out pointers share the control block of the brick
+			TArray<CellPtr> cells;
+
+			int nNumLive = 0;
+			FIntVector brick;
+		};
+
+		static int GetSlot(FIntVector index);
+
+		// Live brick at the brick coords, null if there is none
+		const BrickEntry* FindBrick(FIntVector brick) const;
+		int FindOrAddBrick(FIntVector brick);
+
+		TArray<BrickEntry> bricks;
+		TArray<int> freeBricks;
+
+		// Brick coords -> brick
+		TMap<FIntVector, int> brickIndex;
+
+		int64 nNumCreated = 0;
+		int64 nNumReleased = 0;
+	};
+
+	// Receives cells a volume grid creates and payloads of cells it deletes
+	template<typename T>
+	class TVolumeSink
+	{
+	public:
+		virtual ~TVolumeSink() {}
+
+		virtual void OnCreated(const TSharedPtr<TVolumeCell<T>>& cell) = 0;
+		virtual void OnDeleted(T&& data) = 0;
+	};
+
+	// Sink that keeps everything it gets
+	template<typename T>
+	class TVolumeDelivered : public TVolumeSink<T>
+	{
+	public:
+		TArray<typename TVolumeCell<T>::ptr> created;
+		TArray<T> deleted;
+
+		void OnCreated(const TSharedPtr<TVolumeCell<T>>& cell) override
+		{
+			created.Push(cell);
+		}
+
+		void OnDeleted(T&& data) override
+		{
+			deleted.Push(MoveTemp(data));
+		}
+	};
+
+	// Box of cells around a center, (2 * radius - 1) wide and (2 * height - 1) tall.
+	// Grids of one manager share the cells where their boxes overlap
+	template<typename T>
+	class TVolumeGrid
+	{
+	public:
+		typedef TSharedPtr<TVolumeGrid> ptr;
+		typedef TVolumeCell<T> Cell;
+		typedef TSharedPtr<Cell> CellPtr;
+		typedef TVolumeSink<T> Sink;
+		typedef TVolumeGridManager<T> GridManager;
+
+		TVolumeGrid(GridManager& owner);
+
+		// Height of 0 makes a cube
+		void Init(FIntVector center, int radius, int height, Sink& sink);
+
+		// Cells of the box in front are taken and the ones left behind are dropped, in one pass
+		void MoveTo(FIntVector center, Sink& sink);
+
+		// Height of 0 keeps the box a cube
+		void Resize(int radius, int height, Sink& sink);
+
+		void Clear(Sink& sink);
+
+		bool IsInit() const;
+		FIntVector GetCenter() const;
+		int GetRadius() const;
+		int GetHeight() const;
+
+		bool Contains(FIntVector index) const;
+		CellPtr FindCellByIndex(FIntVector index) const;
+		TArray<CellPtr> GetAllCells() const;
+
+	private:
+		friend class TVolumeGridManager<T>;
+
+		// Shares the loaded cell at index or creates a new one
+		void AcquireCell(FIntVector index, Sink& sink);
+		// Drops one owner of the cell and resets it when nobody owns it anymore
+		void ReleaseCell(const CellPtr& c, Sink& sink);
+
+		// Calls f for every index of the box around center that is out of the box around other.
+		// Extents are half sizes without the center cell, a negative one means there is no box
+		template<typename F>
+		static void ForEachBoxDifference(FIntVector center, FIntVector extent, FIntVector other, FIntVector otherExtent, F&& f);
+
+		FIntVector GetExtent() const;
+
+		GridManager& manager;
+
+		FIntVector center;
+		int nRadius = 1;
+		int nHeight = 1;
+		bool bIsInit = false;
+
+		const int nLimMin = 1;
+		const int nLimMax = 64;
+	};
+
+	// Owns volume grids and the cells they share
+	template<typename T>
+	class TVolumeGridManager
+	{
+	public:
+		typedef TVolumeCell<T> Cell;
+		typedef TSharedPtr<Cell> CellPtr;
+		typedef TVolumeGrid<T> Grid;
+		typedef TSharedPtr<Grid> GridPtr;
+		typedef TVolumeSink<T> Sink;
+		typedef TVolumeDelivered<T> Delivered;
+
+		GridPtr CreateGrid();
+		// Clears the grid and forgets it, payloads of released cells go to the sink
+		bool DestroyGrid(GridPtr g, Sink& sink);
+
+		// Returns the live cell at the world index, shared by all grids of this manager
+		CellPtr FindCell(FIntVector index) const;
+
+		// Live, created and released cells of the manager, slabs are bricks here
+		CellStats GetCellStats() const;
+
+		// Hooks run on the payload of every cell when it is created and before it is released
+		void SetPayloadHooks(TFunction<void(Cell&)> onCreate, TFunction<void(Cell&)> onRelease);
+
+	protected:
+		friend class TVolumeGrid<T>;
+
+		TArray<GridPtr> grids;
+
+		// Storage of every live cell, also serves as spatial index by world position
+		TVolumePool<T> cellPool;
+	};
+
+	// Checks if cell usable
+	template<typename T>
+	bool IsValid(const TSharedPtr<TVolumeCell<T>>& p)
+	{
+		return p.IsValid() && p->IsValid();
+	}
+
+	// Untyped flavour, payload is a pointer to user data
+	typedef TVolumeCell<void*>			VolumeCell;
+	typedef TVolumeSink<void*>			VolumeSink;
+	typedef TVolumeDelivered<void*>		VolumeDelivered;
+	typedef TVolumeGrid<void*>			VolumeGrid;
+	typedef TVolumeGridManager<void*>	VolumeGridManager;
+}
+
+#include "VolumeGrid.inl"
@@ -0,0 +1,497 @@
+#pragma once
+
+namespace serenity
+{
+template<typename T>
+FIntVector TVolumeCell<T>::GetIndex() const
+{
+	return index;
+}
+
+template<typename T>
+T& TVolumeCell<T>::GetData()
+{
+	return Data;
+}
+
+template<typename T>
+int TVolumeCell<T>::NumOwners() const
+{
+	return nNumOwners;
+}
+
+template<typename T>
+bool TVolumeCell<T>::IsValid() const
+{
+	return bIsValid;
+}
+
+template<typename T>
+const TSharedPtr<TVolumeCell<T>>& TVolumeCell<T>::GetN(Direction dir) const
+{
+	static const ptr none = nullptr;
+
+	// Same order as Direction, planar ones match TCell::GetN
+	static const FIntVector offsets[10] = {
+		FIntVector( 1,  0,  0),	// FRONT
+		FIntVector(-1,  0,  0),	// BACK
+		FIntVector( 0, -1,  0),	// LEFT
+		FIntVector( 0,  1,  0),	// RIGHT
+		FIntVector( 1,  1,  0),	// FRONT_RIGHT
+		FIntVector(-1,  1,  0),	// BACK_RIGHT
+		FIntVector(-1, -1,  0),	// BACK_LEFT
+		FIntVector( 1, -1,  0),	// FRONT_LEFT
+		FIntVector( 0,  0,  1),	// TOP
+		FIntVector( 0,  0, -1)	// BOTTOM
+	};
+
+	auto idx = static_cast<uint8_t>(dir);
+	if (idx >= 10)
+		return none;
+
+	return GetNeighbour(offsets[idx]);
+}
+
+template<typename T>
+const TSharedPtr<TVolumeCell<T>>& TVolumeCell<T>::GetNeighbour(FIntVector offset) const
+{
+	static const ptr none = nullptr;
+
+	if (!pool)
+		return none;
+
+	return pool->Find(index + offset);
+}
+
+template<typename T>
+template<typename F>
+void TVolumeCell<T>::ForEachNeighbour(F&& f) const
+{
+	if (!pool)
+		return;
+
+	// Neighbours span at most 8 bricks, consecutive ones mostly share the brick
+	const typename TVolumePool<T>::BrickEntry* entry = nullptr;
+	FIntVector lastBrick;
+	bool bLooked = false;
+
+	for (int dz = -1; dz <= 1; dz++)
+		for (int dy = -1; dy <= 1; dy++)
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				if (!dx && !dy && !dz)
+					continue;
+
+				auto idx = index + FIntVector(dx, dy, dz);
+				auto brick = TVolumePool<T>::GetBrick(idx);
+
+				if (!bLooked || brick != lastBrick)
+				{
+					entry = pool->FindBrick(brick);
+					lastBrick = brick;
+					bLooked = true;
+				}
+
+				if (!entry)
+					continue;
+
+				auto& c = entry->cells[TVolumePool<T>::GetSlot(idx)];
+				if (c->IsValid())
+					f(c);
+			}
+}
+
+////////////////////////////////////////////////////////////////
+
+template<typename T>
+FIntVector TVolumePool<T>::GetBrick(FIntVector index)
+{
+	// Arithmetic shift rounds negative indices down as well
+	return FIntVector(index.X >> BrickShift, index.Y >> BrickShift, index.Z >> BrickShift);
+}
+
+template<typename T>
+int TVolumePool<T>::GetSlot(FIntVector index)
+{
+	const int mask = BrickSide - 1;
+	return (((index.Z & mask) << BrickShift | (index.Y & mask)) << BrickShift) | (index.X & mask);
+}
+
+template<typename T>
+const typename TVolumePool<T>::BrickEntry* TVolumePool<T>::FindBrick(FIntVector brick) const
+{
+	auto found = brickIndex.Find(brick);
+	return found ? &bricks[*found] : nullptr;
+}
+
+template<typename T>
+int TVolumePool<T>::FindOrAddBrick(FIntVector brick)
+{
+	if (auto found = brickIndex.Find(brick))
+		return *found;
+
+	int brickIdx = -1;
+
+	// Reuse an empty brick
+	if (freeBricks.Num())
+	{
+		brickIdx = freeBricks.Pop();
+		bricks[brickIdx].brick = brick;
+	}
+	// Allocate a new one
+	else
+	{
+		BrickEntry entry;
+		entry.data = MakeShareable(new Brick());
+		entry.brick = brick;
+		for (auto& cc : entry.data->cells)
+			entry.cells.Push(CellPtr(entry.data, &cc));
+
+		brickIdx = bricks.Add(entry);
+	}
+
+	brickIndex.Add(brick, brickIdx);
+	return brickIdx;
+}
+
+template<typename T>
+TSharedPtr<TVolumeCell<T>> TVolumePool<T>::Acquire(FIntVector index)
+{
+	auto& entry = bricks[FindOrAddBrick(GetBrick(index))];
+	CellPtr c = entry.cells[GetSlot(index)];
+
+	if (c->IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("VolumePool: cell is already alive."));
+		return c;
+	}
+
+	c->index = index;
+	c->pool = this;
+	c->Data = T();
+	c->nNumOwners = 1;
+	c->bIsValid = true;
+
+	entry.nNumLive++;
+	nNumCreated++;
+
+	if (OnCreate)
+		OnCreate(*c);
+
+	return c;
+}
+
+template<typename T>
+T TVolumePool<T>::Release(CellPtr c)
+{
+	if (!serenity::IsValid(c) || Find(c->GetIndex()) != c)
+		return T();
+
+	if (OnRelease)
+		OnRelease(*c);
+
+	T data = MoveTemp(c->Data);
+	c->Data = T();
+	c->nNumOwners = 0;
+	c->bIsValid = false;
+	nNumReleased++;
+
+	// Whole brick is unloaded
+	int brickIdx = *brickIndex.Find(GetBrick(c->GetIndex()));
+	auto& entry = bricks[brickIdx];
+	if (--entry.nNumLive == 0)
+	{
+		brickIndex.Remove(entry.brick);
+		freeBricks.Push(brickIdx);
+	}
+
+	return data;
+}
+
+template<typename T>
+const TSharedPtr<TVolumeCell<T>>& TVolumePool<T>::Find(FIntVector index) const
+{
+	static const CellPtr none = nullptr;
+
+	auto entry = FindBrick(GetBrick(index));
+	if (!entry)
+		return none;
+
+	auto& c = entry->cells[GetSlot(index)];
+	return c->IsValid() ? c : none;
+}
+
+template<typename T>
+int TVolumePool<T>::NumBricks() const
+{
+	return bricks.Num();
+}
+
+template<typename T>
+int TVolumePool<T>::NumFreeBricks() const
+{
+	return freeBricks.Num();
+}
+
+template<typename T>
+CellStats TVolumePool<T>::GetStats() const
+{
+	CellStats stats;
+	stats.numCreated = nNumCreated;
+	stats.numReleased = nNumReleased;
+	stats.numLive = stats.numCreated - stats.numReleased;
+	stats.numSlabs = NumBricks();
+	stats.numFreeSlabs = NumFreeBricks();
+
+	return stats;
+}
+
+////////////////////////////////////////////////////////////////
+
+template<typename T>
+TVolumeGrid<T>::TVolumeGrid(GridManager& owner) : manager(owner) {}
+
+template<typename T>
+void TVolumeGrid<T>::Init(FIntVector pos, int radius, int height, Sink& sink)
+{
+	if (bIsInit)
+		return;
+
+	nRadius = FMath::Clamp(radius, nLimMin, nLimMax);
+	nHeight = height > 0 ? FMath::Clamp(height, nLimMin, nLimMax) : nRadius;
+	center = pos;
+
+	ForEachBoxDifference(center, GetExtent(), center, FIntVector(-1, -1, -1), [&](FIntVector index)
+		{
+			AcquireCell(index, sink);
+		});
+
+	bIsInit = true;
+}
+
+template<typename T>
+void TVolumeGrid<T>::MoveTo(FIntVector pos, Sink& sink)
+{
+	if (!bIsInit || pos == center)
+		return;
+
+	auto extent = GetExtent();
+
+	// Entering cells first, so cells of both boxes never drop to zero owners
+	ForEachBoxDifference(pos, extent, center, extent, [&](FIntVector index)
+		{
+			AcquireCell(index, sink);
+		});
+
+	ForEachBoxDifference(center, extent, pos, extent, [&](FIntVector index)
+		{
+			ReleaseCell(manager.cellPool.Find(index), sink);
+		});
+
+	center = pos;
+}
+
+template<typename T>
+void TVolumeGrid<T>::Resize(int radius, int height, Sink& sink)
+{
+	if (!bIsInit || radius <= 0)
+		return;
+
+	auto extent = GetExtent();
+
+	nRadius = FMath::Clamp(radius, nLimMin, nLimMax);
+	nHeight = height > 0 ? FMath::Clamp(height, nLimMin, nLimMax) : nRadius;
+
+	auto newExtent = GetExtent();
+
+	ForEachBoxDifference(center, newExtent, center, extent, [&](FIntVector index)
+		{
+			AcquireCell(index, sink);
+		});
+
+	ForEachBoxDifference(center, extent, center, newExtent, [&](FIntVector index)
+		{
+			ReleaseCell(manager.cellPool.Find(index), sink);
+		});
+}
+
+template<typename T>
+void TVolumeGrid<T>::Clear(Sink& sink)
+{
+	if (!bIsInit)
+		return;
+
+	ForEachBoxDifference(center, GetExtent(), center, FIntVector(-1, -1, -1), [&](FIntVector index)
+		{
+			ReleaseCell(manager.cellPool.Find(index), sink);
+		});
+
+	bIsInit = false;
+}
+
+template<typename T>
+bool TVolumeGrid<T>::IsInit() const
+{
+	return bIsInit;
+}
+
+template<typename T>
+FIntVector TVolumeGrid<T>::GetCenter() const
+{
+	return center;
+}
+
+template<typename T>
+int TVolumeGrid<T>::GetRadius() const
+{
+	return nRadius;
+}
+
+template<typename T>
+int TVolumeGrid<T>::GetHeight() const
+{
+	return nHeight;
+}
+
+template<typename T>
+bool TVolumeGrid<T>::Contains(FIntVector index) const
+{
+	auto extent = GetExtent();
+
+	return bIsInit
+		&& FMath::Abs(index.X - center.X) <= extent.X
+		&& FMath::Abs(index.Y - center.Y) <= extent.Y
+		&& FMath::Abs(index.Z - center.Z) <= extent.Z;
+}
+
+template<typename T>
+TSharedPtr<TVolumeCell<T>> TVolumeGrid<T>::FindCellByIndex(FIntVector index) const
+{
+	if (!Contains(index))
+		return nullptr;
+
+	return manager.cellPool.Find(index);
+}
+
+template<typename T>
+TArray<TSharedPtr<TVolumeCell<T>>> TVolumeGrid<T>::GetAllCells() const
+{
+	TArray<CellPtr> cells;
+	if (!bIsInit)
+		return cells;
+
+	auto extent = GetExtent();
+	cells.Reserve((2 * extent.X + 1) * (2 * extent.Y + 1) * (2 * extent.Z + 1));
+
+	ForEachBoxDifference(center, extent, center, FIntVector(-1, -1, -1), [&](FIntVector index)
+		{
+			cells.Push(manager.cellPool.Find(index));
+		});
+
+	return cells;
+}
+
+template<typename T>
+void TVolumeGrid<T>::AcquireCell(FIntVector index, Sink& sink)
+{
+	// Cell could be already loaded by another grid
+	const CellPtr& found = manager.cellPool.Find(index);
+
+	if (IsValid(found))
+	{
+		found->nNumOwners++;
+		return;
+	}
+
+	sink.OnCreated(manager.cellPool.Acquire(index));
+}
+
+template<typename T>
+void TVolumeGrid<T>::ReleaseCell(const CellPtr& c, Sink& sink)
+{
+	if (!IsValid(c))
+		return;
+
+	// Cell is still used by other grids
+	if (--c->nNumOwners > 0)
+		return;
+
+	sink.OnDeleted(manager.cellPool.Release(c));
+}
+
+template<typename T>
+template<typename F>
+void TVolumeGrid<T>::ForEachBoxDifference(FIntVector center, FIntVector extent, FIntVector other, FIntVector otherExtent, F&& f)
+{
+	// Layer by layer and row by row, the order cells lie in bricks
+	for (int z = center.Z - extent.Z; z <= center.Z + extent.Z; z++)
+	{
+		bool bLayerInside = otherExtent.Z >= 0 && FMath::Abs(z - other.Z) <= otherExtent.Z;
+
+		for (int y = center.Y - extent.Y; y <= center.Y + extent.Y; y++)
+		{
+			int x0 = center.X - extent.X;
+			int x1 = center.X + extent.X;
+
+			if (!bLayerInside || otherExtent.Y < 0 || FMath::Abs(y - other.Y) > otherExtent.Y)
+			{
+				for (int x = x0; x <= x1; x++)
+					f(FIntVector(x, y, z));
+				continue;
+			}
+
+			// Row crosses the other box, only its ends are out of it
+			for (int x = x0; x <= FMath::Min(x1, other.X - otherExtent.X - 1); x++)
+				f(FIntVector(x, y, z));
+			for (int x = FMath::Max(x0, other.X + otherExtent.X + 1); x <= x1; x++)
+				f(FIntVector(x, y, z));
+		}
+	}
+}
+
+template<typename T>
+FIntVector TVolumeGrid<T>::GetExtent() const
+{
+	return FIntVector(nRadius - 1, nRadius - 1, nHeight - 1);
+}
+
+////////////////////////////////////////////////////////////////
+
+template<typename T>
+TSharedPtr<TVolumeGrid<T>> TVolumeGridManager<T>::CreateGrid()
+{
+	GridPtr g = MakeShareable(new Grid(*this));
+	grids.Push(g);
+
+	return g;
+}
+
+template<typename T>
+bool TVolumeGridManager<T>::DestroyGrid(GridPtr g, Sink& sink)
+{
+	// Cells of a forgotten grid would never be released otherwise
+	if (g.IsValid())
+		g->Clear(sink);
+
+	return (bool)grids.Remove(g);
+}
+
+template<typename T>
+TSharedPtr<TVolumeCell<T>> TVolumeGridManager<T>::FindCell(FIntVector index) const
+{
+	return cellPool.Find(index);
+}
+
+template<typename T>
+CellStats TVolumeGridManager<T>::GetCellStats() const
+{
+	return cellPool.GetStats();
+}
+
+template<typename T>
+void TVolumeGridManager<T>::SetPayloadHooks(TFunction<void(Cell&)> onCreate, TFunction<void(Cell&)> onRelease)
+{
+	cellPool.OnCreate = MoveTemp(onCreate);
+	cellPool.OnRelease = MoveTemp(onRelease);
+}
+}